@@ -66,21 +66,28 @@ MANIFEST = win/manifest.xml
 
 #-- Begin File Lists --#
 # Edit in Makefile.in, not here!
-NASM    = asm\nasm.obj
+NASM    = asm\main.obj
 NDISASM = disasm\ndisasm.obj
 
 PROGOBJ = $(NASM) $(NDISASM)
 PROGS   = nasm$(X) ndisasm$(X)
 
+BENCHOBJ   = bench\nasmlib-bench.obj
+BENCHPROGS = bench\nasmlib-bench$(X)
+
+LIBTESTOBJ   = test\libtest.obj
+LIBTESTPROGS = test\libtest$(X)
+
 LIBOBJ_NW = stdlib\snprintf.obj stdlib\vsnprintf.obj stdlib\strlcpy.obj \
 	stdlib\strnlen.obj stdlib\strrchrnul.obj \
 	\
 	nasmlib\ver.obj \
-	nasmlib\alloc.obj nasmlib\asprintf.obj nasmlib\errfile.obj \
+	nasmlib\alloc.obj nasmlib\allocstats.obj nasmlib\asprintf.obj \
+	nasmlib\errfile.obj \
 	nasmlib\crc32.obj nasmlib\crc64.obj nasmlib\md5c.obj \
 	nasmlib\string.obj nasmlib\nctype.obj \
-	nasmlib\file.obj nasmlib\mmap.obj nasmlib\ilog2.obj \
-	nasmlib\realpath.obj nasmlib\path.obj \
+	nasmlib\file.obj nasmlib\asyncwrite.obj nasmlib\mmap.obj \
+	nasmlib\ilog2.obj nasmlib\realpath.obj nasmlib\path.obj \
 	nasmlib\filename.obj nasmlib\rlimit.obj \
 	nasmlib\readnum.obj nasmlib\numstr.obj \
 	nasmlib\zerobuf.obj nasmlib\bsi.obj \
@@ -88,6 +95,7 @@ LIBOBJ_NW = stdlib\snprintf.obj stdlib\vsnprintf.obj stdlib\strlcpy.obj \
 	nasmlib\raa.obj nasmlib\saa.obj \
 	nasmlib\strlist.obj \
 	nasmlib\perfhash.obj nasmlib\badenum.obj \
+	nasmlib\trace.obj \
 	\
 	common\common.obj \
 	\
@@ -95,7 +103,7 @@ LIBOBJ_NW = stdlib\snprintf.obj stdlib\vsnprintf.obj stdlib\strlcpy.obj \
 	x86\regs.obj x86\regvals.obj x86\regflags.obj x86\regdis.obj \
 	x86\disp8.obj x86\iflag.obj \
 	\
-	asm\error.obj \
+	asm\nasm.obj asm\error.obj \
 	asm\floats.obj \
 	asm\directiv.obj asm\directbl.obj \
 	asm\pragma.obj \
@@ -107,6 +115,7 @@ LIBOBJ_NW = stdlib\snprintf.obj stdlib\vsnprintf.obj stdlib\strlcpy.obj \
 	asm\segalloc.obj \
 	asm\rdstrnum.obj \
 	asm\srcfile.obj \
+	asm\pipeline.obj asm\passrep.obj \
 	macros\macros.obj \
 	\
 	output\outform.obj output\outlib.obj output\legacy.obj \
@@ -129,7 +138,7 @@ ALLOBJ    = $(PROGOBJ) $(LIBOBJ)
 
 SUBDIRS  = stdlib nasmlib include config output asm disasm x86 \
 	   common macros
-XSUBDIRS = test doc nsis win
+XSUBDIRS = test doc nsis win bench
 DEPDIRS  = . $(SUBDIRS)
 #-- End File Lists --#
 
@@ -165,6 +174,7 @@ PERLREQ_CLEANABLE = \
 	  x86\iflag.c x86\iflaggen.h \
 	  macros\macros.c \
 	  asm\pptok.ph asm\directbl.c asm\directiv.h \
+	  nasmlib\nctype_c.h \
 	  $(WARNFILES) \
 	  misc\nasmtok.el \
 	  version.h version.mac version.mak nsis\version.nsh
@@ -311,6 +321,10 @@ asm\directbl.c: asm\directiv.dat nasmlib\perfhash.pl perllib\phash.ph
 	$(RUNPERL) $(srcdir)\nasmlib\perfhash.pl c \
 		$(srcdir)\asm\directiv.dat asm\directbl.c
 
+# Character class tables
+nasmlib\nctype_c.h: nasmlib\nctype.pl
+	$(RUNPERL) $(srcdir)\nasmlib\nctype.pl nasmlib\nctype_c.h
+
 # Emacs token files
 misc\nasmtok.el: misc\emacstbl.pl asm\tokhash.c asm\pptok.c \
 		 asm\directiv.dat version
@@ -191,17 +191,8 @@ static void warn_overflow_out(int64_t data, int size, enum out_flags flags)
  */
 static void debug_macro_out(const struct out_data *data)
 {
-    struct debug_macro_addr *addr;
-    uint64_t start = data->offset;
-    uint64_t end  = start + data->size;
-
-    addr = debug_macro_get_addr(data->segment);
-    while (addr) {
-        if (!addr->len)
-            addr->start = start;
-        addr->len = end - addr->start;
-        addr = addr->up;
-    }
+    debug_macro_add_range(data->segment, data->offset,
+                          data->offset + data->size);
 }
 
 /*
@@ -1164,6 +1155,217 @@ int64_t insn_size(int32_t segment, int64_t offset, int bits, insn *instruction)
     }
 }
 
+/*
+ * Code alignment padding for the smartalign package.  ALIGN in
+ * smartalign.mac turns into [ALIGNPAD], and ALIGNMODE into
+ * [ALIGNMODE]; the padding is sized and emitted here rather than by
+ * expanding TIMES/DB lines on every pass.
+ *
+ * Each mode sets the NOP sequences and group size it defines for each
+ * of 16, 32 and 64 bits, and leaves anything it does not define as the
+ * previous mode left it, exactly as the old %define based tables did.
+ * In particular, k7 has never set a 16-bit group size.
+ */
+#define NOP_MAX_LEN 8
+
+struct nop_table {
+    int group;                          /* 0 = leave unchanged */
+    const char *nop[NOP_MAX_LEN];       /* nop[n-1] is n bytes long */
+};
+
+struct nop_mode {
+    const char *name;
+    struct nop_table bits[3];           /* 16, 32 and 64 bits */
+};
+
+/* The first entry is the default mode */
+static const struct nop_mode nop_modes[] = {
+    { "generic", {
+        { 8, { "\x90", "\x89\xf6", "\x8d\x74\x00", "\x8d\xb4\x00\x00",
+               "\x8d\xb4\x00\x00\x90", "\x8d\xb4\x00\x00\x89\xff",
+               "\x8d\xb4\x00\x00\x8d\x7d\x00",
+               "\x8d\xb4\x00\x00\x8d\xbd\x00\x00" } },
+        { 7, { "\x90", "\x89\xf6", "\x8d\x76\x00", "\x8d\x74\x26\x00",
+               "\x90\x8d\x74\x26\x00", "\x8d\xb6\x00\x00\x00\x00",
+               "\x8d\xb4\x26\x00\x00\x00\x00" } },
+        { 4, { "\x90", "\x66\x90", "\x66\x66\x90", "\x66\x66\x66\x90" } } } },
+    { "nop", {
+        { 1, { "\x90" } },
+        { 1, { "\x90" } },
+        { 1, { "\x90" } } } },
+    { "k8", {
+        { 4, { "\x90", "\x66\x90", "\x66\x66\x90", "\x66\x66\x66\x90" } },
+        { 4, { "\x90", "\x66\x90", "\x66\x66\x90", "\x66\x66\x66\x90" } },
+        { 4, { "\x90", "\x66\x90", "\x66\x66\x90", "\x66\x66\x66\x90" } } } },
+    { "k7", {
+        { 0, { "\x90", "\x66\x90", "\x66\x66\x90", "\x66\x66\x66\x90" } },
+        { 7, { "\x90", "\x8b\xc0", "\x8d\x04\x20", "\x8d\x44\x20\x00",
+               "\x8d\x44\x20\x00\x90", "\x8d\x80\x00\x00\x00\x00",
+               "\x8d\x04\x05\x00\x00\x00\x00" } },
+        { 4, { "\x90", "\x66\x90", "\x66\x66\x90", "\x66\x66\x66\x90" } } } },
+    { "p6", {
+        { 4, { "\x90", "\x66\x90", "\x0f\x1f\x00", "\x0f\x1f\x40\x00" } },
+        { 8, { "\x90", "\x66\x90", "\x0f\x1f\x00", "\x0f\x1f\x40\x00",
+               "\x0f\x1f\x44\x00\x00", "\x66\x0f\x1f\x44\x00\x00",
+               "\x0f\x1f\x80\x00\x00\x00\x00",
+               "\x0f\x1f\x84\x00\x00\x00\x00\x00" } },
+        { 8, { "\x90", "\x66\x90", "\x0f\x1f\x00", "\x0f\x1f\x40\x00",
+               "\x0f\x1f\x44\x00\x00", "\x66\x0f\x1f\x44\x00\x00",
+               "\x0f\x1f\x80\x00\x00\x00\x00",
+               "\x0f\x1f\x84\x00\x00\x00\x00\x00" } } } },
+};
+
+static struct nop_table cur_nops[3];
+static int64_t nop_jmp_threshold = -1;
+
+static void apply_nop_mode(const struct nop_mode *mode)
+{
+    int i, n;
+
+    for (i = 0; i < 3; i++) {
+        const struct nop_table *nt = &mode->bits[i];
+        struct nop_table *ct = &cur_nops[i];
+
+        if (nt->group)
+            ct->group = nt->group;
+        for (n = 0; n < NOP_MAX_LEN; n++) {
+            if (nt->nop[n])
+                ct->nop[n] = nt->nop[n];
+        }
+    }
+}
+
+bool set_nop_mode(const char *name, int64_t threshold)
+{
+    size_t i;
+
+    if (!cur_nops[0].group)
+        apply_nop_mode(&nop_modes[0]);
+
+    for (i = 0; i < ARRAY_SIZE(nop_modes); i++) {
+        if (!nasm_stricmp(name, nop_modes[i].name)) {
+            apply_nop_mode(&nop_modes[i]);
+            nop_jmp_threshold = threshold;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * The shape of the padding needed at a given offset: either a jump
+ * across single-byte NOPs, or NOP sequences of the current group size
+ * followed by one shorter sequence.
+ */
+struct padding {
+    int jmplen;                 /* 0 = no jump */
+    uint64_t nops;              /* Bytes of NOPs following */
+    const struct nop_table *nt;
+};
+
+static uint64_t pad_to(int64_t offset, uint64_t align)
+{
+    return (align - (uint64_t)offset % align) % align;
+}
+
+static int64_t plan_padding(struct padding *pad, int64_t offset,
+                            int bits, uint64_t align)
+{
+    struct nop_table *nt = &cur_nops[bits == 64 ? 2 : bits == 32 ? 1 : 0];
+    uint64_t nops = pad_to(offset, align);
+
+    if (!nt->group)
+        apply_nop_mode(&nop_modes[0]);
+
+    pad->nt = nt;
+    pad->jmplen = 0;
+
+    if (nop_jmp_threshold != -1 && (int64_t)nops > nop_jmp_threshold) {
+        /* Same choice the optimizer makes for JMP to a forward label */
+        nops = pad_to(offset + 2, align);
+        if (nops <= 127 && optimizing.level > 0 &&
+            !(optimizing.flag & OPTIM_DISABLE_JMP_MATCH)) {
+            pad->jmplen = 2;
+        } else {
+            pad->jmplen = bits == 16 ? 3 : 5;
+            nops = pad_to(offset + pad->jmplen, align);
+        }
+    }
+
+    pad->nops = nops;
+    return pad->jmplen + nops;
+}
+
+int64_t padding_size(int64_t offset, int bits, uint64_t align)
+{
+    struct padding pad;
+
+    return plan_padding(&pad, offset, bits, align);
+}
+
+/*
+ * Output one NOP sequence a byte at a time, as DB did, so BSS and
+ * ABSOLUTE space get the same diagnostics as the old TIMES lines.
+ */
+static void out_nop_seq(struct out_data *data, const char *seq, size_t len)
+{
+    data->insoffs = 0;
+    data->inslen  = len;
+    while (len--)
+        out_rawbyte(data, *seq++);
+}
+
+int64_t assemble_padding(int32_t segment, int64_t start, int bits,
+                         uint64_t align)
+{
+    struct out_data data;
+    struct padding pad;
+    const char *seq;
+    uint64_t n, count;
+    size_t seqlen, rest;
+    int64_t size;
+
+    size = plan_padding(&pad, start, bits, align);
+
+    nasm_zero(data);
+    data.offset = start;
+    data.segment = segment;
+    data.bits = bits;
+
+    if (pad.jmplen) {
+        data.inslen = pad.jmplen;
+        out_rawbyte(&data, pad.jmplen == 2 ? 0xeb : 0xe9);
+        data.type     = OUT_RELADDR;
+        data.flags    = OUT_SIGNED;
+        data.size     = pad.jmplen - 1;
+        data.toffset  = start + size;
+        data.tsegment = segment;
+        data.twrt     = NO_SEG;
+        data.relbase  = start + pad.jmplen;
+        out(&data);
+    }
+
+    /* After a jump the padding is never executed; use plain NOPs */
+    seqlen = pad.jmplen ? 1 : (size_t)pad.nt->group;
+    seq    = pad.jmplen ? "\x90" : pad.nt->nop[seqlen - 1];
+    count  = pad.nops / seqlen;
+    rest   = pad.nops % seqlen;
+
+    /* List the repeated sequence once with a count, like TIMES */
+    for (n = 0; n < count; n++) {
+        if (n == 1)
+            lfmt->uplevel(LIST_TIMES, count);
+        out_nop_seq(&data, seq, seqlen);
+    }
+    if (count > 1)
+        lfmt->downlevel(LIST_TIMES);
+
+    if (rest)
+        out_nop_seq(&data, pad.nt->nop[rest - 1], rest);
+
+    return size;
+}
+
 static void bad_hle_warn(const insn * ins, uint8_t hleok)
 {
     enum prefixes rep_pfx = ins->prefixes[PPS_REP];
@@ -50,7 +50,13 @@ extern struct location absolute;
 int64_t insn_size(int32_t segment, int64_t offset, int bits, insn *instruction);
 int64_t assemble(int32_t segment, int64_t offset, int bits, insn *instruction);
 
+bool set_nop_mode(const char *name, int64_t threshold);
+int64_t padding_size(int64_t offset, int bits, uint64_t align);
+int64_t assemble_padding(int32_t segment, int64_t offset, int bits,
+                         uint64_t align);
+
 bool process_directives(char *);
+void reset_section_specs(void);
 void process_pragma(char *);
 
 #endif
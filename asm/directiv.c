@@ -41,6 +41,7 @@
 
 #include "nasm.h"
 #include "nasmlib.h"
+#include "hashtbl.h"
 #include "ilog2.h"
 #include "error.h"
 #include "floats.h"
@@ -52,6 +53,7 @@
 #include "listing.h"
 #include "labels.h"
 #include "iflag.h"
+#include "pipeline.h"
 
 struct cpunames {
     const char *name;
@@ -205,6 +207,60 @@ static int get_bits(const char *value)
     return i;
 }
 
+/*
+ * Section specifiers (the complete argument to SECTION or SEGMENT,
+ * attributes included) already passed to the backend during this
+ * pass, mapped to the segment number the backend returned.  A
+ * specifier seen again only needs ofmt->section_switch(), not a full
+ * reparse by ofmt->section().
+ */
+struct section_spec {
+    int32_t seg;
+};
+static struct hash_table section_specs;
+
+void reset_section_specs(void)
+{
+    hash_free_all(&section_specs, true);
+}
+
+static int32_t switch_section_spec(char *value, int *bits)
+{
+    struct hash_insert hi;
+    void **ssp;
+    struct section_spec *ss;
+    char *spec;
+    int32_t seg;
+    errhold hold;
+    bool quiet;
+
+    if (!ofmt->section_switch)
+        return ofmt->section(value, bits);
+
+    ssp = hash_find(&section_specs, value, &hi);
+    if (ssp) {
+        ss = *ssp;
+        return ofmt->section_switch(ss->seg, bits);
+    }
+
+    /* The backend is allowed to modify the string */
+    spec = nasm_strdup(value);
+    hold = nasm_error_hold_push();
+    seg = ofmt->section(value, bits);
+    quiet = !nasm_error_hold_seen(hold);
+    nasm_error_hold_pop(hold, true);
+
+    if (seg == NO_SEG || !quiet) {
+        nasm_free(spec);        /* Report the diagnostics again next time */
+    } else {
+        nasm_new(ss);
+        ss->seg = seg;
+        hash_add(&hi, spec, ss);
+    }
+
+    return seg;
+}
+
 static enum directive parse_directive_line(char **directive, char **value)
 {
     char *p, *q, *buf;
@@ -303,7 +359,7 @@ bool process_directives(char *directive)
     case D_SECTION:
     {
 	int sb = globalbits;
-        int32_t seg = ofmt->section(value, &sb);
+        int32_t seg = switch_section_spec(value, &sb);
 
         if (seg == NO_SEG) {
             nasm_nonfatal("segment name `%s' not recognized", value);
@@ -347,6 +403,53 @@ bool process_directives(char *directive)
         break;
     }
 
+    case D_ALIGNMODE:       /* [ALIGNMODE mode[,threshold]] */
+    {
+        char *mode = value;
+        char *p = strchr(value, ',');
+        int64_t threshold = -1;
+	expr *e;
+
+        if (p) {
+            *p++ = '\0';
+            stdscan_reset();
+            stdscan_set(p);
+            tokval.t_type = TOKEN_INVALID;
+            e = evaluate(stdscan, NULL, &tokval, NULL, true, NULL);
+            if (e) {
+                if (!is_simple(e))
+                    nasm_nonfatal("alignment jump threshold must be a constant");
+                else
+                    threshold = reloc_value(e);
+            }
+        }
+        p = nasm_skip_word(mode);
+        if (p)
+            *p = '\0';
+
+        if (!set_nop_mode(mode, threshold))
+            nasm_nonfatal("unknown alignment mode `%s'", mode);
+        break;
+    }
+
+    case D_ALIGNPAD:        /* [ALIGNPAD n] */
+    {
+	expr *e;
+
+        stdscan_reset();
+        stdscan_set(value);
+        tokval.t_type = TOKEN_INVALID;
+        e = evaluate(stdscan, NULL, &tokval, NULL, true, NULL);
+        if (e) {
+            if (!is_simple(e) || (int64_t)reloc_value(e) <= 0)
+                nasm_nonfatal("alignment `%s' is not a positive constant",
+                              value);
+            else
+                process_padding(reloc_value(e));
+        }
+        break;
+    }
+
     case D_BITS:            /* [BITS bits] */
         globalbits = get_bits(value);
         break;
@@ -492,6 +595,7 @@ bool process_directives(char *directive)
     }
 
     case D_WARNING:         /* [WARNING {push|pop|{+|-|*}warn-name}] */
+        pipe_feedback();        /* The preprocessor issues warnings too */
         value = nasm_skip_spaces(value);
         if ((*value | 0x20) == 'p') {
             if (!nasm_stricmp(value, "push"))
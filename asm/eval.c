@@ -45,33 +45,56 @@
 #include "error.h"
 #include "eval.h"
 #include "labels.h"
+#include "passrep.h"
 #include "floats.h"
 #include "assemble.h"
 
 #define TEMPEXPRS_DELTA 128
 #define TEMPEXPR_DELTA 8
 
-static scanner scanfunc;        /* Address of scanner routine */
-static void *scpriv;            /* Scanner private pointer */
+/*
+ * The evaluator is used by both the preprocessor and the assembler
+ * proper, which may run on separate threads in pipelined mode.
+ */
+static thread_local_var scanner scanfunc; /* Address of scanner routine */
+static thread_local_var void *scpriv;     /* Scanner private pointer */
+
+static thread_local_var expr **tempexprs;
+static thread_local_var int ntempexprs;
+static thread_local_var int tempexprs_size;
 
-static expr **tempexprs = NULL;
-static int ntempexprs;
-static int tempexprs_size = 0;
+static thread_local_var expr *tempexpr;
+static thread_local_var int ntempexpr;
+static thread_local_var int tempexpr_size;
 
-static expr *tempexpr;
-static int ntempexpr;
-static int tempexpr_size;
+static thread_local_var struct tokenval *tokval; /* The current token */
+static thread_local_var int tt;                  /* The t_type of tokval */
 
-static struct tokenval *tokval; /* The current token */
-static int tt;                   /* The t_type of tokval */
+static thread_local_var bool critical;
+static thread_local_var int *opflags;
 
-static bool critical;
-static int *opflags;
+static thread_local_var struct eval_hints *hint;
+static thread_local_var int64_t deadman;
 
-static struct eval_hints *hint;
-static int64_t deadman;
+/* Label dependency tracking, if any */
+static thread_local_var struct eval_deps *deps;
 
 
+void eval_track_deps(struct eval_deps *track)
+{
+    deps = track;
+}
+
+static void add_dep(label_handle lh)
+{
+    if (deps->nlabels >= deps->size) {
+        deps->size = deps->size ? deps->size << 1 : 4;
+        deps->labels = nasm_realloc(deps->labels,
+                                    deps->size * sizeof(*deps->labels));
+    }
+    deps->labels[deps->nlabels++] = lh;
+}
+
 /*
  * Unimportant cleanup is done to avoid confusing people who are trying
  * to debug real memory leaks
@@ -80,7 +103,8 @@ void eval_cleanup(void)
 {
     while (ntempexprs)
         nasm_free(tempexprs[--ntempexprs]);
-    nasm_free(tempexprs);
+    nasm_delete(tempexprs);
+    tempexprs_size = 0;
 }
 
 /*
@@ -963,12 +987,29 @@ static expr *expr6(void)
             if (tt == TOKEN_BASE) {
                 label_seg = in_absolute ? absolute.segment : location.segment;
                 label_ofs = 0;
+                if (deps)
+                    deps->cacheable = false;
             } else if (tt == TOKEN_HERE) {
                 label_seg = in_absolute ? absolute.segment : location.segment;
                 label_ofs = in_absolute ? absolute.offset : location.offset;
+                if (deps)
+                    deps->cacheable = false;
             } else {
                 enum label_type ltype;
-                ltype = lookup_label(tokval->t_charptr, &label_seg, &label_ofs);
+                label_handle lh = NULL;
+                ltype = lookup_label_handle(tokval->t_charptr,
+                                            &label_seg, &label_ofs, &lh);
+                if (unlikely(passrep_active))
+                    passrep_ref(lh);
+                if (deps) {
+                    /* Local labels depend on the current label base */
+                    const char *l = tokval->t_charptr;
+                    if (ltype == LBL_none || is_extern(ltype) ||
+                        (l[0] == '.' && l[1] != '.'))
+                        deps->cacheable = false;
+                    else
+                        add_dep(lh);
+                }
                 if (ltype == LBL_none) {
                     scope = local_scope(tokval->t_charptr);
                     if (critical) {
@@ -979,6 +1020,8 @@ static expr *expr6(void)
                     }
                     if (opflags)
                         *opflags |= OPFLAG_FORWARD;
+                    if (pass_first())
+                        first_pass_fwref = true;
                     type = EXPR_UNKNOWN;
                     label_seg = NO_SEG;
                     label_ofs = 1;
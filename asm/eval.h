@@ -38,6 +38,8 @@
 #ifndef NASM_EVAL_H
 #define NASM_EVAL_H
 
+#include "labels.h"
+
 /*
  * The evaluator itself.
  */
@@ -46,4 +48,17 @@ expr *evaluate(scanner sc, void *scprivate, struct tokenval *tv,
 
 void eval_cleanup(void);
 
+/*
+ * Record the labels referenced by subsequent calls to evaluate().
+ * "cacheable" is cleared if a result depends on anything other than
+ * the values of the recorded labels, e.g. $ or an undefined symbol.
+ * Pass NULL to stop recording.
+ */
+struct eval_deps {
+    label_handle *labels;
+    size_t nlabels, size;
+    bool cacheable;
+};
+void eval_track_deps(struct eval_deps *deps);
+
 #endif
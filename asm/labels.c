@@ -43,6 +43,7 @@
 #include "error.h"
 #include "hashtbl.h"
 #include "labels.h"
+#include "passrep.h"
 
 /*
  * A dot-local label is one that begins with exactly one period. Things
@@ -109,6 +110,7 @@ union label {                   /* actual label structures */
         int64_t size;
         int64_t defined;        /* 0 if undefined, passn+1 for when defn seen */
         int64_t lastref;        /* Last pass where we saw a reference */
+        uint64_t serial;        /* label_serial_now() at last value change */
         char *label, *mangled, *special;
         const char *def_file;   /* Where defined */
         int32_t def_line;
@@ -129,6 +131,8 @@ struct permts {                 /* permanent text storage */
 #define PERMTS_HEADER offsetof(struct permts, data)
 
 uint64_t global_offset_changed;		/* counter for global offset changes */
+bool first_pass_fwref;                  /* forward reference seen in pass 1 */
+static uint64_t label_serial_counter;   /* bumped on every label change */
 
 static struct hash_table ltab;          /* labels hash table */
 static union label *ldata;              /* all label data blocks */
@@ -238,6 +242,8 @@ static union label *find_label(const char *label, bool create, bool *created)
     lptr = lpp ? *lpp : NULL;
 
     if (lptr || !create) {
+        if (label_str)
+            nasm_free(label_str);
         if (created)
             *created = false;
         return lptr;
@@ -268,6 +274,17 @@ static union label *find_label(const char *label, bool create, bool *created)
 
 enum label_type lookup_label(const char *label,
                              int32_t *segment, int64_t *offset)
+{
+    return lookup_label_handle(label, segment, offset, NULL);
+}
+
+/*
+ * Same as lookup_label(), but also return a handle which can later be
+ * passed to label_serial() to find out if the value has changed.
+ */
+enum label_type lookup_label_handle(const char *label,
+                                    int32_t *segment, int64_t *offset,
+                                    label_handle *handle)
 {
     union label *lptr;
 
@@ -281,12 +298,34 @@ enum label_type lookup_label(const char *label,
         lptr->defn.lastref = lpass;
         *segment = lptr->defn.segment;
         *offset = lptr->defn.offset;
+        if (handle)
+            *handle = lptr;
         return lptr->defn.type;
     }
 
     return LBL_none;
 }
 
+/*
+ * The serial number of a label is the value of label_serial_now()
+ * the last time the label was created or changed value.
+ */
+uint64_t label_serial(label_handle handle)
+{
+    return handle->defn.serial;
+}
+
+/* The full name of a label, valid until cleanup_labels() */
+const char *label_name(label_handle handle)
+{
+    return handle->defn.label;
+}
+
+uint64_t label_serial_now(void)
+{
+    return label_serial_counter;
+}
+
 static inline bool is_global(enum label_type type)
 {
     return type == LBL_GLOBAL || type == LBL_COMMON;
@@ -469,6 +508,9 @@ void define_label(const char *label, int32_t segment,
             /* auto-promote EXTERN/REQUIRED to GLOBAL */
             lptr->defn.type = LBL_GLOBAL;
             lastdef = 0; /* We are "re-creating" this label */
+            /* Any use so far in pass 1 was a forward reference */
+            if (pass_first() && lptr->defn.lastref == lpass)
+                first_pass_fwref = true;
         }
     } else {
         /* It's a pseudo-segment (extern, required, common) */
@@ -503,10 +545,16 @@ void define_label(const char *label, int32_t segment,
         lptr->defn.offset != offset ||
         lptr->defn.size != size;
     global_offset_changed += changed;
+    if (changed) {
+        if (unlikely(passrep_active))
+            passrep_label(lptr, lptr->defn.label, created || !lastdef,
+                          lptr->defn.segment, lptr->defn.offset,
+                          segment, offset);
+        lptr->defn.serial = ++label_serial_counter;
+    }
 
     if (lastdef == lpass) {
-        int32_t saved_line = 0;
-        const char *saved_fname = NULL;
+        struct src_location defined_at, saved;
         int noteflags;
 
         /*
@@ -527,10 +575,16 @@ void define_label(const char *label, int32_t segment,
             noteflags = ERR_WARNING|ERR_HERE|ERR_NO_SEVERITY|WARN_LABEL_REDEF;
         }
 
-        src_get(&saved_line, &saved_fname);
-        src_set(lptr->defn.def_line, lptr->defn.def_file);
+        /*
+         * The filename is already in the hash, so this does not need
+         * to go through src_set(); that matters in pipelined mode,
+         * where the hash belongs to the preprocessor thread.
+         */
+        defined_at.filename = lptr->defn.def_file;
+        defined_at.lineno   = lptr->defn.def_line;
+        saved = src_update(defined_at);
         nasm_error(noteflags, "info: label `%s' originally defined", lptr->defn.label);
-        src_set(saved_line, saved_fname);
+        src_update(saved);
     } else if (changed && pass_final() && lptr->defn.type != LBL_SPECIAL) {
         /*!
          *!label-redef-late [err] label (re)defined during code generation
@@ -577,6 +631,8 @@ void backend_label(const char *label, int32_t segment, int64_t offset)
 
 int init_labels(void)
 {
+    size_t i;
+
     ldata = lfree = nasm_malloc(LBLK_SIZE);
     init_block(lfree);
 
@@ -589,6 +645,12 @@ int init_labels(void)
 
     prevlabel = "";
 
+    /* The mangle strings live in the permanent storage just freed */
+    for (i = 0; i < ARRAY_SIZE(mangle_strings); i++) {
+        mangle_strings[i] = "";
+        mangle_string_set[i] = false;
+    }
+
     initialized = true;
 
     return 0;
@@ -609,6 +671,7 @@ void cleanup_labels(void)
         nasm_free(lhold);
         lhold = lptr;
     }
+    ldata = lfree = NULL;
 
     while (perm_head) {
         perm_tail = perm_head;
@@ -617,6 +680,23 @@ void cleanup_labels(void)
     }
 }
 
+/*
+ * Call func for every label which has been defined
+ */
+void label_for_each(label_func func, void *data)
+{
+    struct hash_iterator it;
+    const struct hash_node *np;
+
+    hash_for_each(&ltab, it, np) {
+        const union label *lptr = np->data;
+
+        if (lptr->defn.defined)
+            func(lptr->defn.label, lptr->defn.type,
+                 lptr->defn.segment, lptr->defn.offset, data);
+    }
+}
+
 static void init_block(union label *blk)
 {
     int j;
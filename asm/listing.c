@@ -44,6 +44,7 @@
 #include "error.h"
 #include "strlist.h"
 #include "listing.h"
+#include "pipeline.h"
 
 #define LIST_MAX_LEN 1024       /* something sensible */
 #define LIST_INDENT  40
@@ -148,6 +149,10 @@ static void list_cleanup(void)
 
 static void list_init(const char *fname)
 {
+    /*
+     * Not NF_ASYNC: the listing is written during the final pass,
+     * which a writer thread would slow down more than it gains.
+     */
     enum file_flags flags = NF_TEXT;
 
     if (listfp)
@@ -406,6 +411,7 @@ enum directive_result list_pragma(const struct pragma *pragma)
 {
     switch (pragma->opcode) {
     case D_OPTIONS:
+        pipe_feedback();        /* Also used by the preprocessor */
         list_update_options(pragma->tail);
         return DIRR_OK;
 
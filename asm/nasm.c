@@ -37,6 +37,7 @@
 
 #include "compiler.h"
 
+#include <setjmp.h>
 
 #include "nasm.h"
 #include "nasmlib.h"
@@ -56,7 +57,11 @@
 #include "listing.h"
 #include "iflag.h"
 #include "quote.h"
+#include "pipeline.h"
+#include "passrep.h"
+#include "trace.h"
 #include "ver.h"
+#include "libnasm.h"
 
 /*
  * This is the maximum number of optimization passes to do.  If we ever
@@ -72,6 +77,7 @@ struct forwrefinfo {            /* info held on forward refs. */
 
 const char *_progname;
 
+static void reset_options(void);
 static void parse_cmdline(int, char **, int);
 static void assemble_file(const char *, struct strlist *);
 static bool skip_this_pass(errflags severity);
@@ -88,7 +94,7 @@ static const struct error_format errfmt_gnu  = { ":", "",  ": "  };
 static const struct error_format errfmt_msvc = { "(", ")", " : " };
 static const struct error_format *errfmt = &errfmt_gnu;
 static struct strlist *warn_list;
-static struct nasm_errhold *errhold_stack;
+static thread_local_var struct nasm_errhold *errhold_stack;
 
 unsigned int debug_nasm;        /* Debugging messages? */
 
@@ -100,6 +106,9 @@ static const char *debug_format;
 #endif
 static bool abort_on_panic = ABORT_ON_PANIC;
 static bool keep_all;
+static bool opt_pipeline;       /* Preprocess on a separate thread */
+static const char *trace_name;  /* Trace event file (--trace-events) */
+static uint64_t trace_usec;     /* Macro span threshold (--trace-threshold) */
 
 bool tasm_compatible_mode = false;
 enum pass_type _pass_type;
@@ -160,8 +169,27 @@ struct strlist *depend_list;
 
 static bool want_usage;
 static bool terminate_after_phase;
+static bool in_critical_error;
 bool user_nolist = false;
 
+/*
+ * State of a nasm_assemble_buffer() call; NULL when running from
+ * the command line.
+ */
+struct lib_session {
+    jmp_buf fatal;              /* Where fatal errors unwind to */
+    struct nasm_membuf out;     /* Output file */
+    struct nasm_membuf err;     /* Diagnostics */
+    struct nasm_result *result;
+    size_t symsize;             /* Allocated size of result->symbols */
+    int status;                 /* Exit status after a fatal error */
+};
+static struct lib_session *lib_session;
+
+/* The file names used by nasm_assemble_buffer() */
+static const char lib_inname[]  = "<buffer>";
+static const char lib_outname[] = "<output>";
+
 static char *quote_for_pmake(const char *str);
 static char *quote_for_wmake(const char *str);
 static char *(*quote_for_make)(const char *) = quote_for_pmake;
@@ -514,14 +542,115 @@ static void timestamp(void)
     }
 }
 
-int main(int argc, char **argv)
+/*
+ * Open the output file; for the library interface this is a memory
+ * buffer.
+ */
+static FILE *open_output(enum file_flags flags)
+{
+    if (lib_session)
+        ofile = lib_session->out.f;
+    else
+        ofile = nasm_open_write(outname, flags);
+
+    if (!ofile)
+        nasm_fatal("unable to open output file `%s'", outname);
+
+    return ofile;
+}
+
+static void close_output(void)
+{
+    if (!ofile)
+        return;
+
+    if (lib_session) {
+        fflush(ofile);          /* The buffer is closed by the caller */
+    } else {
+        /* The output may be written in the background; check it here */
+        if (fclose(ofile) && !terminate_after_phase)
+            nasm_nonfatal("write error on output file `%s': %s",
+                          outname, strerror(errno));
+        if (terminate_after_phase && !keep_all)
+            remove(outname);
+    }
+    ofile = NULL;
+}
+
+static void add_lib_symbol(const char *label, enum label_type type,
+                           int32_t segment, int64_t offset, void *data)
+{
+    struct lib_session *ls = data;
+    struct nasm_result *res = ls->result;
+    struct nasm_symbol *sym;
+
+    switch (type) {
+    case LBL_SPECIAL:
+    case LBL_BACKEND:
+        return;
+    default:
+        break;
+    }
+
+    if (res->nsymbols >= ls->symsize) {
+        ls->symsize = ls->symsize ? ls->symsize << 1 : 64;
+        res->symbols = nasm_realloc(res->symbols,
+                                    ls->symsize * sizeof *res->symbols);
+    }
+
+    sym = &res->symbols[res->nsymbols++];
+    sym->name    = nasm_strdup(label);
+    sym->segment = segment;
+    sym->offset  = offset;
+    sym->flags   = 0;
+    if (type == LBL_GLOBAL || type == LBL_COMMON)
+        sym->flags |= NASM_SYM_GLOBAL;
+    if (type == LBL_COMMON)
+        sym->flags |= NASM_SYM_COMMON;
+    if (is_extern(type))
+        sym->flags |= NASM_SYM_EXTERN;
+}
+
+/*
+ * Free the state of an assembly session
+ */
+static void cleanup_session(void)
+{
+    raa_free(offsets);
+    offsets = NULL;
+    if (forwrefs) {
+        saa_free(forwrefs);
+        forwrefs = NULL;
+    }
+    eval_cleanup();
+    stdscan_cleanup();
+    src_free();
+    strlist_free(&include_path);
+
+    /* All of these are allocated copies by now */
+    nasm_free((char *)inname);
+    nasm_free((char *)outname);
+    nasm_free((char *)listname);
+    nasm_free((char *)errname);
+    nasm_free((char *)depend_file);
+    nasm_free((char *)depend_target);
+    inname = outname = listname = errname = NULL;
+    depend_target = depend_file = NULL;
+}
+
+int nasm_main(int argc, char **argv)
 {
     /* Do these as early as possible */
-    error_file = stderr;
+    src_init();
+    error_file = lib_session ? lib_session->err.f : stderr;
     _progname = argv[0];
     if (!_progname || !_progname[0])
         _progname = "nasm";
 
+    in_critical_error = false;
+    reset_options();
+    seg_alloc_reset();
+
     timestamp();
 
     set_cpu(NULL);
@@ -536,9 +665,6 @@ int main(int argc, char **argv)
 
     want_usage = terminate_after_phase = false;
 
-    nasm_ctype_init();
-    src_init();
-
     /*
      * We must call init_labels() before the command line parsing,
      * because we may be setting prefixes/suffixes from the command
@@ -555,6 +681,8 @@ int main(int argc, char **argv)
     if (terminate_after_phase) {
         if (want_usage)
             usage();
+        cleanup_labels();
+        cleanup_session();
         return 1;
     }
 
@@ -584,9 +712,16 @@ int main(int argc, char **argv)
     if (terminate_after_phase) {
         if (want_usage)
             usage();
+        cleanup_labels();
+        cleanup_session();
         return 1;
     }
 
+    if (trace_name && !trace_open(trace_name, trace_usec * 1000)) {
+        nasm_fatalf(ERR_USAGE, "this build of NASM does not support "
+                    "`--trace-events'; configure it with --enable-trace-events");
+    }
+
     /* Save away the default state of warnings */
     init_warnings();
 
@@ -604,9 +739,13 @@ int main(int argc, char **argv)
      * fine to output into stdout.
      */
     if (!outname && !(operating_mode & OP_PREPROCESS)) {
-        outname = filename_set_extension(inname, ofmt->extension);
+        if (lib_session)
+            outname = nasm_strdup(lib_outname);
+        else
+            outname = filename_set_extension(inname, ofmt->extension);
         if (!strcmp(outname, inname)) {
-            outname = "nasm.out";
+            nasm_free((char *)outname);
+            outname = nasm_strdup("nasm.out");
             nasm_warn(WARN_OTHER, "default output file same as input, using `%s' for output\n", outname);
         }
     }
@@ -635,12 +774,14 @@ int main(int argc, char **argv)
             int32_t linnum  = 0;
             int32_t lineinc = 0;
             FILE *out;
+            trace_time_t pass_start;
 
-            if (outname) {
-                ofile = nasm_open_write(outname, NF_TEXT);
-                if (!ofile)
-                    nasm_fatal("unable to open output file `%s'", outname);
-                out = ofile;
+            /*
+             * Not NF_ASYNC: the output is written as it is produced,
+             * so a writer thread would run during all the work.
+             */
+            if (outname || lib_session) {
+                out = open_output(NF_TEXT);
             } else {
                 ofile = NULL;
                 out = stdout;
@@ -649,6 +790,7 @@ int main(int argc, char **argv)
             location.known = false;
 
             _pass_type = PASS_PREPROC;
+            TRACE_BEGIN(pass_start);
             pp_reset(inname, PP_PREPROC, depend_list);
 
             while ((line = pp_getline())) {
@@ -697,18 +839,14 @@ int main(int argc, char **argv)
             nasm_free(quoted_file_name);
 
             pp_cleanup_pass();
+            TRACE_END(pass_start, "pass", pass_type_name());
             reset_warnings();
-            if (ofile)
-                fclose(ofile);
-            if (ofile && terminate_after_phase && !keep_all)
-                remove(outname);
-            ofile = NULL;
+            close_output();
     }
 
     if (operating_mode & OP_NORMAL) {
-        ofile = nasm_open_write(outname, (ofmt->flags & OFMT_TEXT) ? NF_TEXT : NF_BINARY);
-        if (!ofile)
-            nasm_fatal("unable to open output file `%s'", outname);
+        open_output(((ofmt->flags & OFMT_TEXT) ? NF_TEXT : NF_BINARY) |
+                    NF_ASYNC);
 
         ofmt->init();
         dfmt->init();
@@ -716,21 +854,26 @@ int main(int argc, char **argv)
         assemble_file(inname, depend_list);
 
         if (!terminate_after_phase) {
+            trace_time_t output_start;
+
+            TRACE_BEGIN(output_start);
             ofmt->cleanup();
-            cleanup_labels();
+            TRACE_END(output_start, "output", ofmt->shortname);
+            if (lib_session)
+                label_for_each(add_lib_symbol, lib_session);
             fflush(ofile);
             if (ferror(ofile))
                 nasm_nonfatal("write error on output file `%s'", outname);
         }
 
-        if (ofile) {
-            fclose(ofile);
-            if (terminate_after_phase && !keep_all)
-                remove(outname);
-            ofile = NULL;
-        }
+        close_output();
     }
 
+    cleanup_labels();
+
+    if (ppopt & PP_STATS)
+        pp_print_stats(error_file);
+
     pp_cleanup_session();
 
     if (depend_list && !terminate_after_phase)
@@ -739,16 +882,98 @@ int main(int argc, char **argv)
     if (want_usage)
         usage();
 
-    raa_free(offsets);
-    saa_free(forwrefs);
-    eval_cleanup();
-    stdscan_cleanup();
-    src_free();
-    strlist_free(&include_path);
+    cleanup_session();
+    trace_close();
 
     return terminate_after_phase;
 }
 
+/*
+ * Release what a fatal error in nasm_assemble_buffer() left behind,
+ * so the next call starts from a clean state.
+ */
+static void lib_cleanup_fatal(void)
+{
+    pp_cleanup_pass();
+    pp_cleanup_session();
+    parser_cleanup();
+    cleanup_labels();
+    strlist_free(&warn_list);
+    errhold_stack = NULL;
+    cleanup_session();
+    trace_close();
+}
+
+int nasm_assemble_buffer(const char *source, size_t len,
+                         const char * const *options,
+                         struct nasm_result *result)
+{
+    struct lib_session ls;
+    char **argv;
+    int argc, i;
+
+    nasm_zero(*result);
+    nasm_zero(ls);
+    ls.result = result;
+
+    for (argc = 1; options && options[argc-1]; argc++)
+        ;
+    nasm_newn(argv, argc + 2);
+    argv[0] = nasm_strdup("nasm");
+    for (i = 1; i < argc; i++)
+        argv[i] = nasm_strdup(options[i-1]);
+    argv[argc++] = nasm_strdup(lib_inname);
+
+    if (!nasm_membuf_open(&ls.out) || !nasm_membuf_open(&ls.err)) {
+        result->status = 1;
+        goto done;
+    }
+
+    nasm_set_memfile(lib_inname, source, len);
+    lib_session = &ls;
+
+    if (!setjmp(ls.fatal)) {
+        result->status = nasm_main(argc, argv);
+    } else {
+        result->status = ls.status;
+        /* Should the cleanup itself die, give up on the rest of it */
+        if (!setjmp(ls.fatal))
+            lib_cleanup_fatal();
+    }
+
+    lib_session = NULL;
+    nasm_set_memfile(NULL, NULL, 0);
+    error_file = stderr;
+
+done:
+    result->output = (unsigned char *)
+        nasm_membuf_close(&ls.out, &result->output_len);
+    result->diagnostics = nasm_membuf_close(&ls.err, &result->diagnostics_len);
+    if (result->status) {
+        free(result->output);
+        result->output = NULL;
+        result->output_len = 0;
+    }
+
+    for (i = 0; i < argc; i++)
+        nasm_free(argv[i]);
+    nasm_free(argv);
+
+    return result->status;
+}
+
+void nasm_free_result(struct nasm_result *result)
+{
+    size_t i;
+
+    for (i = 0; i < result->nsymbols; i++)
+        nasm_free(result->symbols[i].name);
+    nasm_free(result->symbols);
+    free(result->output);
+    free(result->diagnostics);
+    nasm_zero(*result);
+}
+
 /*
  * Get a parameter for a command line option.
  * First arg must be in the form of e.g. -f...
@@ -947,7 +1172,12 @@ enum text_options {
     OPT_KEEP_ALL,
     OPT_NO_LINE,
     OPT_DEBUG,
-    OPT_REPRODUCIBLE
+    OPT_REPRODUCIBLE,
+    OPT_PIPELINE,
+    OPT_PASS_REPORT,
+    OPT_PP_STATS,
+    OPT_TRACE_EVENTS,
+    OPT_TRACE_THRESHOLD
 };
 enum need_arg {
     ARG_NO,
@@ -980,9 +1210,25 @@ static const struct textargs textopts[] = {
     {"no-line",  OPT_NO_LINE, ARG_NO, 0},
     {"debug",    OPT_DEBUG, ARG_MAYBE, 0},
     {"reproducible", OPT_REPRODUCIBLE, ARG_NO, 0},
+    {"pipeline", OPT_PIPELINE, ARG_NO, 0},
+    {"pass-report", OPT_PASS_REPORT, ARG_NO, 0},
+    {"pp-stats", OPT_PP_STATS, ARG_NO, 0},
+    {"trace-events", OPT_TRACE_EVENTS, ARG_YES, 0},
+    {"trace-threshold", OPT_TRACE_THRESHOLD, ARG_YES, 0},
     {NULL, OPT_BOGUS, ARG_NO, 0}
 };
 
+/*
+ * Options which only print something and exit make no sense when
+ * assembling a buffer, and must not end the caller's process.
+ */
+static void lib_reject_option(const char *opt)
+{
+    if (lib_session)
+        nasm_fatal("option `%s' cannot be used with nasm_assemble_buffer()",
+                   opt);
+}
+
 static void show_version(void)
 {
     printf("NASM version %s compiled on %s%s\n",
@@ -991,6 +1237,43 @@ static void show_version(void)
 }
 
 static bool stopoptions = false;
+
+/*
+ * Reset the options to their defaults, in case we are assembling
+ * more than once in the same process.
+ */
+static void reset_options(void)
+{
+    errfmt = &errfmt_gnu;
+    using_debug_info = opt_verbose_info = false;
+    debug_format = NULL;
+    abort_on_panic = ABORT_ON_PANIC;
+    keep_all = false;
+    tasm_compatible_mode = false;
+    globalrel = globalbnd = 0;
+    inname = outname = listname = errname = NULL;
+    ofmt = &OF_DEFAULT;
+    ofmt_alias = NULL;
+    dfmt = NULL;
+    optimizing.level = MAX_OPTIMIZE;
+    optimizing.flag = OPTIM_ALL_ENABLED;
+    cmd_sb = 16;
+    ppopt = 0;
+    depend_emit_phony = depend_missing_ok = false;
+    depend_target = depend_file = NULL;
+    depend_list = NULL;
+    quote_for_make = quote_for_pmake;
+    stopoptions = false;
+    user_nolist = false;
+    list_options = 0;
+    debug_nasm = 0;
+    reproducible = false;
+    opt_pipeline = false;
+    pass_report = false;
+    trace_name = NULL;
+    trace_usec = 100;
+}
+
 static bool process_arg(char *p, char *q, int pass)
 {
     char *param;
@@ -1145,12 +1428,14 @@ static bool process_arg(char *p, char *q, int pass)
 
         case 'h':
         case '?':
+            lib_reject_option(p);
             help(stdout, get_opt_param(p, q, &advance));
             exit(0);    /* never need usage message here */
             break;
 
         case 'y':
             /* legacy option */
+            lib_reject_option(p);
             help(stdout, "-F");
             exit(0);
             break;
@@ -1161,6 +1446,7 @@ static bool process_arg(char *p, char *q, int pass)
             break;
 
         case 'v':
+            lib_reject_option(p);
             show_version();
             break;
 
@@ -1211,19 +1497,23 @@ static bool process_arg(char *p, char *q, int pass)
                 case 'D':
                     operating_mode |= OP_DEPEND;
                     if (q && (q[0] != '-' || q[1] == '\0')) {
-                        depend_file = q;
+                        nasm_free((char *)depend_file);
+                        depend_file = nasm_strdup(q);
                         advance = true;
                     }
                     break;
                 case 'F':
-                    depend_file = q;
+                    nasm_free((char *)depend_file);
+                    depend_file = nasm_strdup(q);
                     advance = true;
                     break;
                 case 'T':
-                    depend_target = q;
+                    nasm_free((char *)depend_target);
+                    depend_target = nasm_strdup(q);
                     advance = true;
                     break;
                 case 'Q':
+                    nasm_free((char *)depend_target);
                     depend_target = quote_for_make(q);
                     advance = true;
                     break;
@@ -1312,6 +1602,7 @@ static bool process_arg(char *p, char *q, int pass)
                 case OPT_BOGUS:
                     break;      /* We have already errored out */
                 case OPT_VERSION:
+                    lib_reject_option("--version");
                     show_version();
                     break;
                 case OPT_ABORT_ON_PANIC:
@@ -1350,10 +1641,36 @@ static bool process_arg(char *p, char *q, int pass)
                 case OPT_REPRODUCIBLE:
                     reproducible = true;
                     break;
+                case OPT_PIPELINE:
+                    opt_pipeline = true;
+                    break;
+                case OPT_PASS_REPORT:
+                    pass_report = true;
+                    break;
+                case OPT_PP_STATS:
+                    ppopt |= PP_STATS;
+                    break;
+                case OPT_TRACE_EVENTS:
+                    trace_name = param;
+                    break;
+                case OPT_TRACE_THRESHOLD:
+                    {
+                        bool rn_error;
+                        int64_t val = readnum(param, &rn_error);
+
+                        if (rn_error || val < 0)
+                            nasm_nonfatalf(ERR_USAGE,
+                                           "invalid argument to `--%s': `%s'",
+                                           p, param);
+                        else
+                            trace_usec = val;
+                    }
+                    break;
                 case OPT_HELP:
                     /* Allow --help topic without *requiring* topic */
                     if (!param)
                         param = q;
+                    lib_reject_option("--help");
                     help(stdout, param);
                     exit(0);
                 default:
@@ -1471,6 +1788,11 @@ static void process_response_file(const char *file, int pass)
     char str[2048];
     FILE *f = nasm_open_read(file, NF_TEXT);
     if (!f) {
+        if (lib_session) {
+            nasm_nonfatalf(ERR_USAGE, "unable to open response file `%s'",
+                           file);
+            return;
+        }
         perror(file);
         exit(-1);
     }
@@ -1613,6 +1935,8 @@ static void process_insn(insn *instruction)
             if (l != -1)
                 increment_offset(l);
         }
+        if (unlikely(passrep_active))
+            passrep_insn(location.segment, location.offset - start);
         if (list_option('p')) {
             struct out_data dummy;
             memset(&dummy, 0, sizeof dummy);
@@ -1639,12 +1963,35 @@ static void process_insn(insn *instruction)
     }
 }
 
+void process_padding(uint64_t align)
+{
+    int64_t start = location.offset;
+
+    if (!pass_final()) {
+        increment_offset(padding_size(start, globalbits, align));
+        if (unlikely(passrep_active))
+            passrep_insn(location.segment, location.offset - start);
+        if (list_option('p')) {
+            struct out_data dummy;
+            memset(&dummy, 0, sizeof dummy);
+            dummy.type   = OUT_RAWDATA; /* Handled specially with .data NULL */
+            dummy.offset = start;
+            dummy.size   = location.offset - start;
+            lfmt->output(&dummy);
+        }
+    } else {
+        increment_offset(assemble_padding(location.segment, start,
+                                          globalbits, align));
+    }
+}
+
 static void assemble_file(const char *fname, struct strlist *depend_list)
 {
     char *line;
     insn output_ins;
     uint64_t prev_offset_changed;
     int64_t stall_count = 0; /* Make sure we make forward progress... */
+    trace_time_t pass_start;
 
     switch (cmd_sb) {
     case 16:
@@ -1675,6 +2022,15 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
         case PASS_INIT:
             _pass_type = PASS_FIRST;
             break;
+        case PASS_FIRST:
+            /*
+             * If no expression in the first pass used a label before
+             * its definition, every size and label value it computed
+             * is already final, and optimizing could not change any
+             * of them.
+             */
+            _pass_type = first_pass_fwref ? PASS_OPT : PASS_STAB;
+            break;
         case PASS_OPT:
             if (global_offset_changed)
                 break;          /* One more optimization pass */
@@ -1685,6 +2041,8 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
         }
 
         global_offset_changed = 0;
+        first_pass_fwref = false;
+        TRACE_BEGIN(pass_start);
 
 	/*
 	 * Create a warning buffer list unless we are in
@@ -1726,12 +2084,22 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
         if (pass_first())
             location.known = true;
         ofmt->reset();
+        reset_section_specs();
         switch_segment(ofmt->section(NULL, &globalbits));
+        passrep_start_pass();
         pp_reset(fname, PP_NORMAL, depend_list);
 
+        /*
+         * The list file and debug information are generated from
+         * state shared with the preprocessor, so they are not
+         * compatible with running it on a separate thread.
+         */
+        pipe_start(opt_pipeline && pass_final() && !lib_session &&
+                   !listname && !using_debug_info);
+
         globallineno = 0;
 
-        while ((line = pp_getline())) {
+        while ((line = pipe_getline())) {
             if (++globallineno > nasm_limit[LIMIT_LINES])
                 nasm_fatal("overall line count exceeds the maximum %"PRId64"\n",
                            nasm_limit[LIMIT_LINES]);
@@ -1751,8 +2119,9 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
 
         end_of_line:
             nasm_free(line);
-        }                       /* end while (line = pp_getline... */
+        }                       /* end while (line = pipe_getline... */
 
+        pipe_finish();
         pp_cleanup_pass();
 
         /* We better not be having an error hold still... */
@@ -1809,6 +2178,7 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
         }
 
         reset_warnings();
+        TRACE_END_ARG(pass_start, "pass", pass_type_name(), "pass", _passn);
     }
 
     if (opt_verbose_info && pass_final()) {
@@ -1816,6 +2186,10 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
         nasm_info("assembly required 1+%"PRId64"+2 passes\n", pass_count()-3);
     }
 
+    passrep_print(error_file);
+
+    reset_section_specs();
+    parser_cleanup();
     lfmt->cleanup();
     strlist_free(&warn_list);
 }
@@ -1879,14 +2253,22 @@ static bool is_suppressed(errflags severity)
     if ((severity & ERR_MASK) >= ERR_FATAL)
         return false;
 
-    /* This error/warning is pointless if we are dead anyway */
-    if ((severity & ERR_UNDEAD) && terminate_after_phase)
+    /*
+     * This error/warning is pointless if we are dead anyway. On the
+     * preprocessor thread, this is checked when the error is issued.
+     */
+    if ((severity & ERR_UNDEAD) && terminate_after_phase &&
+        pipe_role != PIPE_PRODUCER)
         return true;
 
     if (!(warning_state[warn_index(severity)] & WARN_ST_ENABLED))
         return true;
 
-    if (!(severity & ERR_PP_LISTMACRO))
+    /*
+     * The preprocessor state belongs to the preprocessor thread; any
+     * line it has handed over was not in a suppressed context.
+     */
+    if (!(severity & ERR_PP_LISTMACRO) && pipe_role != PIPE_CONSUMER)
         return pp_suppress_error(severity);
 
     return false;
@@ -1957,17 +2339,18 @@ static fatal_func die_hard(errflags true_type, errflags severity)
     if (true_type == ERR_PANIC && abort_on_panic)
         abort();
 
-    if (ofile) {
-        fclose(ofile);
-        if (!keep_all)
-            remove(outname);
-        ofile = NULL;
-    }
+    terminate_after_phase = true;
+    close_output();
 
     if (severity & ERR_USAGE)
         usage();
 
-    /* Terminate immediately */
+    /* Return to the library caller, or terminate immediately */
+    if (lib_session) {
+        lib_session->status = true_type - ERR_FATAL + 1;
+        longjmp(lib_session->fatal, 1);
+    }
+
     exit(true_type - ERR_FATAL + 1);
 }
 
@@ -2006,12 +2389,11 @@ fatal_func nasm_verror_critical(errflags severity, const char *fmt, va_list args
 {
     struct src_location where;
     errflags true_type = severity & ERR_MASK;
-    static bool been_here = false;
 
-    if (unlikely(been_here))
+    if (unlikely(in_critical_error))
         abort();                /* Recursive error... just die */
 
-    been_here = true;
+    in_critical_error = true;
 
     where = error_where(severity);
     if (!where.filename)
@@ -2043,6 +2425,7 @@ struct nasm_errtext {
 struct nasm_errhold {
     struct nasm_errhold *up;
     struct nasm_errtext *head, **tail;
+    bool seen;                  /* Anything raised, even if suppressed */
 };
 
 static void nasm_free_error(struct nasm_errtext *et)
@@ -2053,6 +2436,55 @@ static void nasm_free_error(struct nasm_errtext *et)
 
 static void nasm_issue_error(struct nasm_errtext *et);
 
+/*
+ * Errors deferred on the preprocessor thread in pipelined mode.
+ */
+static thread_local_var struct nasm_errtext *errdefer_head;
+static thread_local_var struct nasm_errtext **errdefer_tail;
+
+/*
+ * Issue an error, or defer it if we are on the preprocessor thread.
+ */
+static void nasm_commit_error(struct nasm_errtext *et)
+{
+    if (pipe_role != PIPE_PRODUCER) {
+        nasm_issue_error(et);
+        return;
+    }
+
+    if (!errdefer_tail)
+        errdefer_tail = &errdefer_head;
+
+    et->next = NULL;
+    *errdefer_tail = et;
+    errdefer_tail = &et->next;
+
+    /* The assembler thread will terminate once it gets to this */
+    if (et->true_type >= ERR_FATAL)
+        pipe_abort();
+}
+
+struct nasm_errtext *nasm_error_take_deferred(void)
+{
+    struct nasm_errtext *list = errdefer_head;
+
+    errdefer_head = NULL;
+    errdefer_tail = NULL;
+    return list;
+}
+
+void nasm_error_issue_deferred(struct nasm_errtext *list)
+{
+    struct nasm_errtext *et, *etmp;
+
+    list_for_each_safe(et, etmp, list) {
+        if (is_suppressed(et->severity))
+            nasm_free_error(et);
+        else
+            nasm_issue_error(et);
+    }
+}
+
 struct nasm_errhold *nasm_error_hold_push(void)
 {
     struct nasm_errhold *eh;
@@ -2085,7 +2517,7 @@ void nasm_error_hold_pop(struct nasm_errhold *eh, bool issue)
             } else {
                 /* Issue errors */
                 list_for_each_safe(et, etmp, eh->head)
-                    nasm_issue_error(et);
+                    nasm_commit_error(et);
             }
         } else {
             /* Free the list, drop errors */
@@ -2098,6 +2530,11 @@ void nasm_error_hold_pop(struct nasm_errhold *eh, bool issue)
     nasm_free(eh);
 }
 
+bool nasm_error_hold_seen(errhold eh)
+{
+    return eh && eh->seen;
+}
+
 /**
  * common error reporting
  * This is the common back end of the error reporting schemes currently
@@ -2116,6 +2553,9 @@ void nasm_verror(errflags severity, const char *fmt, va_list args)
     if (true_type >= ERR_CRITICAL)
         nasm_verror_critical(severity, fmt, args);
 
+    if (errhold_stack)
+        errhold_stack->seen = true;
+
     if (is_suppressed(severity))
         return;
 
@@ -2130,7 +2570,7 @@ void nasm_verror(errflags severity, const char *fmt, va_list args)
         *errhold_stack->tail = et;
         errhold_stack->tail = &et->next;
     } else {
-        nasm_issue_error(et);
+        nasm_commit_error(et);
     }
 
     /*
@@ -2235,10 +2675,12 @@ static void nasm_issue_error(struct nasm_errtext *et)
     if (skip_this_pass(severity))
         goto done;
 
-    if (true_type >= ERR_FATAL)
+    if (true_type >= ERR_FATAL) {
+        nasm_free_error(et);    /* A library session returns from here */
         die_hard(true_type, severity);
-    else if (true_type >= ERR_NONFATAL)
+    } else if (true_type >= ERR_NONFATAL) {
         terminate_after_phase = true;
+    }
 
 done:
     nasm_free_error(et);
@@ -2535,6 +2977,17 @@ static void help(FILE *out, const char *what)
             "    --lprefix str  prepend the given string to local symbols\n"
             "    --lpostfix str append the given string to local symbols\n"
             "    --reproducible attempt to produce run-to-run identical output\n"
+            "    --pipeline     run the preprocessor on a separate thread in the\n"
+            "                   final pass, when possible\n"
+            "    --pass-report  report which labels and instructions kept\n"
+            "                   changing during the optimization passes\n"
+            "    --pp-stats     print preprocessor line, token and macro counts\n"
+            "    --trace-events file\n"
+            "                   write a trace of the passes, include files and\n"
+            "                   macros for a trace viewer (if built with\n"
+            "                   --enable-trace-events)\n"
+            "    --trace-threshold usec\n"
+            "                   omit macro expansions shorter than this [100]\n"
             , out);
     }
     if (help_optor(with, HW_LIMIT)) {
@@ -49,10 +49,126 @@
 #include "floats.h"
 #include "assemble.h"
 #include "tables.h"
+#include "labels.h"
+#include "hashtbl.h"
+#include "passrep.h"
 
 
 static int end_expression_next(void);
 
+/*
+ * Parsed EQU operands, keyed by the source text following EQU.  An
+ * entry is only made when the value depends on nothing but already
+ * defined labels, and stays valid as long as none of those labels has
+ * changed since; this saves re-evaluating long chains of constants on
+ * every optimization pass.  The final pass always evaluates afresh so
+ * that all diagnostics are issued as usual.
+ */
+struct equ_value {
+    uint64_t serial;            /* label_serial_now() when evaluated */
+    int operands;
+    operand oprs[2];
+    struct eval_deps deps;
+};
+static struct hash_table equ_values;
+static struct eval_deps equ_deps;
+
+static bool equ_value_valid(const struct equ_value *ev)
+{
+    size_t i;
+
+    for (i = 0; i < ev->deps.nlabels; i++) {
+        if (label_serial(ev->deps.labels[i]) > ev->serial)
+            return false;
+    }
+    return true;
+}
+
+/* Takes ownership of text */
+static void equ_value_save(char *text, const insn *result)
+{
+    struct hash_insert hi;
+    void **evp;
+    struct equ_value *ev;
+    int i;
+
+    if (!equ_deps.cacheable || result->operands < 1 || result->operands > 2)
+        goto nocache;
+
+    for (i = 0; i < result->operands; i++) {
+        if (result->oprs[i].opflags &
+            (OPFLAG_FORWARD|OPFLAG_EXTERN|OPFLAG_UNKNOWN))
+            goto nocache;
+    }
+
+    evp = hash_find(&equ_values, text, &hi);
+    if (evp) {
+        ev = *evp;
+        nasm_free(text);
+    } else {
+        nasm_new(ev);
+        hash_add(&hi, text, ev);
+    }
+
+    ev->serial   = label_serial_now();
+    ev->operands = result->operands;
+    memcpy(ev->oprs, result->oprs, sizeof ev->oprs);
+
+    ev->deps.nlabels = equ_deps.nlabels;
+    if (ev->deps.size < equ_deps.nlabels) {
+        ev->deps.size = equ_deps.nlabels;
+        ev->deps.labels = nasm_realloc(ev->deps.labels,
+                                       ev->deps.size * sizeof(label_handle));
+    }
+    if (equ_deps.nlabels)
+        memcpy(ev->deps.labels, equ_deps.labels,
+               equ_deps.nlabels * sizeof(label_handle));
+    return;
+
+nocache:
+    nasm_free(text);
+}
+
+static bool equ_value_lookup(const char *text, insn *result)
+{
+    void **evp;
+    const struct equ_value *ev;
+
+    evp = hash_find(&equ_values, text, NULL);
+    if (!evp)
+        return false;
+
+    ev = *evp;
+    if (!equ_value_valid(ev))
+        return false;
+
+    /* Report the references the evaluator would have seen */
+    if (unlikely(passrep_active)) {
+        size_t i;
+
+        for (i = 0; i < ev->deps.nlabels; i++)
+            passrep_ref(ev->deps.labels[i]);
+    }
+
+    result->operands = ev->operands;
+    memcpy(result->oprs, ev->oprs, sizeof ev->oprs);
+    return true;
+}
+
+void parser_cleanup(void)
+{
+    struct hash_iterator it;
+    const struct hash_node *np;
+
+    hash_for_each(&equ_values, it, np) {
+        struct equ_value *ev = np->data;
+        nasm_free(ev->deps.labels);
+    }
+    hash_free_all(&equ_values, true);
+    nasm_delete(equ_deps.labels);
+    equ_deps.size = equ_deps.nlabels = 0;
+}
+
 static struct tokenval tokval;
 
 /*
@@ -631,6 +747,7 @@ insn *parse_line(char *buffer, insn *result)
     bool first;
     bool recover;
     bool far_jmp_ok;
+    char *equ_text = NULL;      /* Copy: scanning modifies the buffer */
     int i;
 
     nasm_static_assert(P_none == 0);
@@ -775,6 +892,16 @@ restart_parse:
 
     result->opcode = tokval.t_integer;
 
+    if (result->opcode == I_EQU && result->label && !pass_final()) {
+        if (equ_value_lookup(stdscan_get(), result))
+            return result;
+
+        equ_text = nasm_strdup(stdscan_get());
+        equ_deps.nlabels   = 0;
+        equ_deps.cacheable = true;
+        eval_track_deps(&equ_deps);
+    }
+
     /*
      * INCBIN cannot be satisfied with incorrectly
      * evaluated operands, since the correct values _must_ be known
@@ -1299,9 +1426,16 @@ restart_parse:
 
     result->operands = opnum; /* set operand count */
 
+    if (equ_text) {
+        eval_track_deps(NULL);
+        equ_value_save(equ_text, result);
+    }
+
     return result;
 
 fail:
+    eval_track_deps(NULL);
+    nasm_free(equ_text);
     result->opcode = I_none;
     return result;
 }
@@ -41,5 +41,6 @@
 
 insn *parse_line(char *buffer, insn *result);
 void cleanup_insn(insn *instruction);
+void parser_cleanup(void);
 
 #endif
@@ -0,0 +1,489 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * passrep.c - the --pass-report option
+ *
+ * When the optimizer needs many passes, the reason is almost always
+ * a chain: an instruction changes size because a label it refers to
+ * moved in the previous pass, which moves the labels after it, which
+ * changes the size of other instructions, and so on.  To make those
+ * chains visible we record, for every pass after the first, which
+ * labels changed value and by how much, which instructions changed
+ * size, and for each of them the change that most likely caused it:
+ *
+ * - for an instruction, the first label it refers to which changed
+ *   in the previous pass or earlier in this one, or, in the second
+ *   pass, which was a forward reference in the first;
+ * - for a label defined by an expression (EQU), likewise the first
+ *   label the expression refers to;
+ * - for any other label, the nearest preceding instruction in the
+ *   same section which changed size.
+ *
+ * Instructions are matched up between passes by their ordinal number
+ * in the pass, so the report gets confused if the preprocessor
+ * generates different code in different passes.
+ */
+
+#include "compiler.h"
+
+#include "nasm.h"
+#include "nasmlib.h"
+#include "hashtbl.h"
+#include "raa.h"
+#include "srcfile.h"
+#include "labels.h"
+#include "passrep.h"
+
+#define PASSREP_SHOW 10         /* Entries shown per pass and category */
+
+bool pass_report;
+bool passrep_active;
+
+/* What we remember about a label across passes */
+struct label_hist {
+    label_handle handle;        /* Hash key */
+    const char *name;
+    struct src_location where;  /* Where it was last defined */
+    int64_t pass;               /* The last pass in which it changed... */
+    int64_t delta;              /* ...by how much... */
+    bool new_label, moved;      /* ...or if it was new or changed section */
+    int64_t changes;            /* Number of passes in which it changed */
+};
+
+/* A snapshot of the label change something depends on */
+struct change_ref {
+    const char *name;           /* NULL if none */
+    int64_t pass;
+    int64_t delta;
+    bool new_label, moved;
+    struct src_location where;  /* Where the reference was made */
+};
+
+struct label_change {
+    size_t order;               /* Order in which it happened */
+    const char *name;
+    struct src_location where;
+    int64_t delta;
+    bool new_label, moved;
+    struct change_ref ref;      /* The label it was computed from... */
+    bool after;                 /* ...or the instruction it follows */
+    struct src_location after_where;
+    int64_t after_delta;
+};
+
+struct insn_change {
+    size_t order;
+    struct src_location where;
+    int32_t segment;
+    int64_t oldsize, newsize;
+    struct change_ref ref;
+};
+
+struct pass_rec {
+    struct pass_rec *next;
+    int64_t passn;
+    enum pass_type type;
+    struct label_change *labels;
+    size_t nlabels, labels_max;
+    struct insn_change *insns;
+    size_t ninsns, insns_max;
+};
+
+static struct pass_rec *passes, **passes_tail = &passes;
+static struct pass_rec *cur_pass;
+static struct hash_table label_hists;
+static struct RAA *insn_sizes;  /* Size + 1 of each instruction, by ordinal */
+static struct RAA *first_fwd;   /* Forward references in the first pass */
+static int64_t insn_count;      /* Instructions seen in this pass */
+static uint64_t prev_pass_serial, cur_pass_serial;
+static struct change_ref cur_ref;
+static struct insn_change last_change; /* Latest size change this pass */
+
+void passrep_start_pass(void)
+{
+    passrep_active = pass_report && !pass_final();
+    if (!passrep_active)
+        return;
+
+    prev_pass_serial = cur_pass_serial;
+    cur_pass_serial  = label_serial_now();
+    insn_count = 0;
+    cur_ref.name = NULL;
+    last_change.ref.name = NULL;
+    last_change.where.filename = NULL;
+    last_change.segment = NO_SEG;
+    cur_pass = NULL;
+
+    /* In the first pass, everything is new; just collect the sizes */
+    if (pass_first())
+        return;
+
+    nasm_new(cur_pass);
+    cur_pass->passn = pass_count();
+    cur_pass->type  = pass_type();
+    *passes_tail = cur_pass;
+    passes_tail = &cur_pass->next;
+}
+
+/*
+ * Return the label the current line refers to, if any, and forget
+ * about it.
+ */
+static struct change_ref take_ref(void)
+{
+    struct change_ref ref = cur_ref;
+    struct src_location here = src_where();
+
+    if (ref.name && (ref.where.filename != here.filename ||
+                     ref.where.lineno != here.lineno))
+        ref.name = NULL;        /* Left over from another line */
+
+    cur_ref.name = NULL;
+    return ref;
+}
+
+void passrep_label(label_handle lh, const char *name, bool new_label,
+                   int32_t oldseg, int64_t oldofs,
+                   int32_t seg, int64_t ofs)
+{
+    struct label_hist *h;
+    struct label_change *lc;
+    struct hash_insert hi;
+    void **hp;
+
+    if (!cur_pass)
+        return;
+
+    hp = hash_findb(&label_hists, &lh, sizeof lh, &hi);
+    if (hp) {
+        h = *hp;
+    } else {
+        nasm_new(h);
+        h->handle = lh;
+        hash_add(&hi, &h->handle, h);
+    }
+
+    h->name  = name;
+    h->where = src_where();
+    h->new_label = new_label;
+    h->moved = new_label || oldseg != seg;
+    h->delta = h->moved ? 0 : ofs - oldofs;
+    if (h->pass != cur_pass->passn)
+        h->changes++;
+    h->pass  = cur_pass->passn;
+
+    if (cur_pass->nlabels >= cur_pass->labels_max) {
+        cur_pass->labels_max = cur_pass->labels_max * 2 + 16;
+        cur_pass->labels = nasm_realloc(cur_pass->labels,
+                            cur_pass->labels_max * sizeof *cur_pass->labels);
+    }
+    lc = &cur_pass->labels[cur_pass->nlabels];
+    nasm_zero(*lc);
+    lc->order     = cur_pass->nlabels++;
+    lc->name      = name;
+    lc->where     = h->where;
+    lc->delta     = h->delta;
+    lc->new_label = new_label;
+    lc->moved     = h->moved;
+    lc->ref       = take_ref();
+    if (!lc->ref.name && last_change.segment == seg && seg != NO_SEG) {
+        lc->after       = true;
+        lc->after_where = last_change.where;
+        lc->after_delta = last_change.newsize - last_change.oldsize;
+    }
+}
+
+void passrep_ref(label_handle lh)
+{
+    const struct label_hist *h;
+    void **hp;
+
+    if (!cur_pass) {
+        /* Remember which instructions had forward references */
+        if (!lh)
+            first_fwd = raa_write(first_fwd, insn_count, 1);
+        return;
+    }
+
+    if (cur_ref.name || !lh)
+        return;                 /* Only the first one on each line */
+
+    if (label_serial(lh) <= prev_pass_serial)
+        return;                 /* Has not changed recently */
+
+    hp = hash_findb(&label_hists, &lh, sizeof lh, NULL);
+    if (hp) {
+        h = *hp;
+        cur_ref.name  = h->name;
+        cur_ref.pass  = h->pass;
+        cur_ref.delta = h->delta;
+        cur_ref.new_label = h->new_label;
+        cur_ref.moved = h->moved;
+    } else {
+        /*
+         * Defined in the first pass, and not changed since; only of
+         * interest if it was not yet defined when used in that pass.
+         */
+        if (!raa_read(first_fwd, insn_count))
+            return;
+        cur_ref.name  = label_name(lh);
+        cur_ref.pass  = 1;
+        cur_ref.delta = 0;
+        cur_ref.new_label = true;
+        cur_ref.moved = true;
+    }
+    cur_ref.where = src_where();
+}
+
+void passrep_insn(int32_t seg, int64_t size)
+{
+    int64_t n = insn_count++;
+    int64_t oldsize = raa_read(insn_sizes, n) - 1;
+    struct insn_change *ic;
+
+    insn_sizes = raa_write(insn_sizes, n, size + 1);
+
+    if (!cur_pass || oldsize < 0 || oldsize == size) {
+        cur_ref.name = NULL;
+        return;
+    }
+
+    if (cur_pass->ninsns >= cur_pass->insns_max) {
+        cur_pass->insns_max = cur_pass->insns_max * 2 + 16;
+        cur_pass->insns = nasm_realloc(cur_pass->insns,
+                            cur_pass->insns_max * sizeof *cur_pass->insns);
+    }
+    ic = &cur_pass->insns[cur_pass->ninsns];
+    ic->order   = cur_pass->ninsns++;
+    ic->where   = src_where();
+    ic->segment = seg;
+    ic->oldsize = oldsize;
+    ic->newsize = size;
+    ic->ref     = take_ref();
+    last_change = *ic;
+}
+
+static inline int64_t absval(int64_t x)
+{
+    return x < 0 ? -x : x;
+}
+
+/*
+ * Largest changes first, otherwise in source order; new labels and
+ * section changes count as the largest.
+ */
+static int cmp_labels(const void *a, const void *b)
+{
+    const struct label_change *la = a, *lb = b;
+    int64_t da = la->moved ? INT64_MAX : absval(la->delta);
+    int64_t db = lb->moved ? INT64_MAX : absval(lb->delta);
+
+    if (da != db)
+        return da < db ? 1 : -1;
+    return (la->order > lb->order) - (la->order < lb->order);
+}
+
+static int cmp_insns(const void *a, const void *b)
+{
+    const struct insn_change *ia = a, *ib = b;
+    int64_t da = absval(ia->newsize - ia->oldsize);
+    int64_t db = absval(ib->newsize - ib->oldsize);
+
+    if (da != db)
+        return da < db ? 1 : -1;
+    return (ia->order > ib->order) - (ia->order < ib->order);
+}
+
+static int cmp_hists(const void *a, const void *b)
+{
+    const struct label_hist *ha = *(const struct label_hist * const *)a;
+    const struct label_hist *hb = *(const struct label_hist * const *)b;
+
+    if (ha->changes != hb->changes)
+        return ha->changes < hb->changes ? 1 : -1;
+    return strcmp(ha->name, hb->name);
+}
+
+static void print_where(FILE *f, struct src_location where)
+{
+    fprintf(f, "  %s:%"PRId32": ",
+            where.filename ? where.filename : "nasm", where.lineno);
+}
+
+static void print_ref(FILE *f, const struct change_ref *ref)
+{
+    if (ref->new_label && ref->pass == 1)
+        fprintf(f, ", uses `%s' (forward reference in pass 1)\n",
+                ref->name);
+    else if (ref->new_label)
+        fprintf(f, ", uses `%s' (defined in pass %"PRId64")\n",
+                ref->name, ref->pass);
+    else if (ref->moved)
+        fprintf(f, ", uses `%s' (changed section in pass %"PRId64")\n",
+                ref->name, ref->pass);
+    else
+        fprintf(f, ", uses `%s' (%+"PRId64" in pass %"PRId64")\n",
+                ref->name, ref->delta, ref->pass);
+}
+
+static void print_pass(FILE *f, struct pass_rec *pr)
+{
+    size_t i;
+
+    fprintf(f, "pass %"PRId64" (%s): %"PRIu64" label%s changed, "
+            "%"PRIu64" instruction%s changed size\n",
+            pr->passn, _pass_types[pr->type],
+            (uint64_t)pr->nlabels, pr->nlabels == 1 ? "" : "s",
+            (uint64_t)pr->ninsns, pr->ninsns == 1 ? "" : "s");
+
+    qsort(pr->insns, pr->ninsns, sizeof *pr->insns, cmp_insns);
+    for (i = 0; i < pr->ninsns && i < PASSREP_SHOW; i++) {
+        const struct insn_change *ic = &pr->insns[i];
+
+        print_where(f, ic->where);
+        fprintf(f, "instruction %"PRId64" -> %"PRId64" bytes",
+                ic->oldsize, ic->newsize);
+        if (ic->ref.name)
+            print_ref(f, &ic->ref);
+        else
+            fputc('\n', f);
+    }
+    if (pr->ninsns > PASSREP_SHOW)
+        fprintf(f, "  ... and %"PRIu64" more instruction%s\n",
+                (uint64_t)(pr->ninsns - PASSREP_SHOW),
+                pr->ninsns - PASSREP_SHOW == 1 ? "" : "s");
+
+    qsort(pr->labels, pr->nlabels, sizeof *pr->labels, cmp_labels);
+    for (i = 0; i < pr->nlabels && i < PASSREP_SHOW; i++) {
+        const struct label_change *lc = &pr->labels[i];
+
+        print_where(f, lc->where);
+        if (lc->new_label)
+            fprintf(f, "label `%s' defined", lc->name);
+        else if (lc->moved)
+            fprintf(f, "label `%s' changed section", lc->name);
+        else
+            fprintf(f, "label `%s' %+"PRId64, lc->name, lc->delta);
+
+        if (lc->ref.name) {
+            print_ref(f, &lc->ref);
+        } else if (lc->after) {
+            fprintf(f, ", after %+"PRId64" bytes at %s:%"PRId32"\n",
+                    lc->after_delta,
+                    lc->after_where.filename ?
+                    lc->after_where.filename : "nasm",
+                    lc->after_where.lineno);
+        } else {
+            fputc('\n', f);
+        }
+    }
+    if (pr->nlabels > PASSREP_SHOW)
+        fprintf(f, "  ... and %"PRIu64" more label%s\n",
+                (uint64_t)(pr->nlabels - PASSREP_SHOW),
+                pr->nlabels - PASSREP_SHOW == 1 ? "" : "s");
+}
+
+/* The labels which changed in the largest number of passes */
+static void print_worst(FILE *f)
+{
+    struct hash_iterator it;
+    const struct hash_node *np;
+    struct label_hist **hists;
+    size_t n, i;
+
+    n = 0;
+    hash_for_each(&label_hists, it, np) {
+        const struct label_hist *h = np->data;
+        n += h->changes > 1;
+    }
+    if (!n)
+        return;
+
+    nasm_newn(hists, n);
+    i = 0;
+    hash_for_each(&label_hists, it, np) {
+        struct label_hist *h = np->data;
+        if (h->changes > 1)
+            hists[i++] = h;
+    }
+    qsort(hists, n, sizeof *hists, cmp_hists);
+
+    fprintf(f, "labels changed in the most passes:\n");
+    for (i = 0; i < n && i < PASSREP_SHOW; i++) {
+        print_where(f, hists[i]->where);
+        fprintf(f, "`%s' changed in %"PRId64" passes\n",
+                hists[i]->name, hists[i]->changes);
+    }
+    nasm_free(hists);
+}
+
+void passrep_print(FILE *f)
+{
+    struct pass_rec *pr, *next;
+    bool any = false;
+
+    if (!pass_report)
+        return;
+
+    for (pr = passes; pr; pr = pr->next) {
+        if (pr->nlabels || pr->ninsns) {
+            if (!any)
+                fprintf(f, "pass report: %"PRId64" passes\n", pass_count());
+            any = true;
+            print_pass(f, pr);
+        }
+    }
+    if (any)
+        print_worst(f);
+    else
+        fprintf(f, "pass report: %"PRId64" passes, "
+                "no changes after the first pass\n", pass_count());
+
+    for (pr = passes; pr; pr = next) {
+        next = pr->next;
+        nasm_free(pr->labels);
+        nasm_free(pr->insns);
+        nasm_free(pr);
+    }
+    passes = cur_pass = NULL;
+    passes_tail = &passes;
+    hash_free_all(&label_hists, false);
+    raa_free(insn_sizes);
+    insn_sizes = raa_init();
+    raa_free(first_fwd);
+    first_fwd = raa_init();
+    prev_pass_serial = cur_pass_serial = 0;
+    passrep_active = false;
+}
@@ -0,0 +1,66 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * passrep.h - record why the optimizer needed as many passes as it did
+ */
+
+#ifndef NASM_PASSREP_H
+#define NASM_PASSREP_H
+
+#include "compiler.h"
+#include "labels.h"
+
+/* Set by --pass-report; only check passrep_active in the hooks */
+extern bool pass_report;
+extern bool passrep_active;
+
+/* Called at the start of every pass, before the preprocessor is reset */
+void passrep_start_pass(void);
+
+/* A label changed value; seg/ofs are the previous values, if any */
+void passrep_label(label_handle lh, const char *name, bool new_label,
+                   int32_t oldseg, int64_t oldofs,
+                   int32_t seg, int64_t ofs);
+
+/* An expression on the current line refers to a label */
+void passrep_ref(label_handle lh);
+
+/* An instruction (including all TIMES repeats) took this many bytes */
+void passrep_insn(int32_t seg, int64_t size);
+
+/* Print the report and free everything */
+void passrep_print(FILE *f);
+
+#endif /* NASM_PASSREP_H */
@@ -0,0 +1,352 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * pipeline.c - run the preprocessor on its own thread in the final pass
+ *
+ * Once the label values have converged, the output of the
+ * preprocessor normally does not depend on anything the assembler
+ * proper does, so in the final pass the two can run concurrently:
+ * the preprocessor runs on a producer thread and hands the expanded
+ * lines to the assembler through a single-producer, single-consumer
+ * ring buffer.
+ *
+ * This is only true if the preprocessor never reads assembler state
+ * (labels, $, __?BITS?__ ...) and the assembler never changes state
+ * the preprocessor uses ([warning], %pragma limit ...). Each pass
+ * records such "feedback" via pipe_feedback(); if the previous pass
+ * had none, the final pass will not have any either, as its
+ * preprocessor run is identical (__?PASS?__ counts as feedback, too).
+ * Should the preprocessor thread nevertheless hit a feedback point,
+ * it waits for the assembler to catch up before going on.
+ *
+ * Each slot in the ring carries a line, the location stack as of that
+ * line, and any diagnostics issued while producing it; these are
+ * issued by the assembler thread before it processes the line, so
+ * the output is the same as in lockstep mode.
+ */
+
+#include "compiler.h"
+
+#include "nasm.h"
+#include "nasmlib.h"
+#include "error.h"
+#include "eval.h"
+#include "srcfile.h"
+#include "pipeline.h"
+#include "trace.h"
+
+#ifdef HAVE_THREADS
+# include <pthread.h>
+# include <stdatomic.h>
+#endif
+
+thread_local_var enum pipe_role pipe_role;
+
+/* Set if the current pass has seen any feedback */
+static bool feedback_seen;
+
+#ifdef HAVE_THREADS
+
+#define PIPE_RING_SIZE  512     /* Lines in flight, must be a power of 2 */
+#define PIPE_RING_MASK  (PIPE_RING_SIZE - 1)
+#define PIPE_BATCH      32      /* Lines to queue before waking the consumer */
+#define PIPE_STACK_MAX  ((size_t)256 << 20)
+
+struct pipe_slot {
+    char *line;                   /* NULL at the end of the input */
+    struct nasm_errtext *errors;  /* Deferred diagnostics for this line */
+    struct src_saved_stack where; /* Location stack for this line */
+};
+
+static struct pipe_slot *ring;
+
+/*
+ * ring_head is only written by the producer, and ring_tail only by
+ * the consumer, which keeps using the slot at ring_tail until it asks
+ * for the next line.
+ */
+static atomic_size_t ring_head, ring_tail;
+static bool consumer_holding;
+
+/*
+ * When either side cannot make progress, it sleeps on pipe_lock. The
+ * flags below are only set while holding the lock, and let the other
+ * side skip taking it unless a wakeup is actually needed.
+ */
+enum producer_wait {
+    WAIT_NONE,
+    WAIT_SPACE,                 /* The ring is full */
+    WAIT_SYNC                   /* Waiting for the consumer to catch up */
+};
+static pthread_mutex_t pipe_lock     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  producer_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  consumer_wake = PTHREAD_COND_INITIALIZER;
+static atomic_int  producer_waiting;
+static atomic_bool consumer_sleeping;
+
+static pthread_t producer_thread;
+static struct src_location producer_start;
+
+static void wake(pthread_cond_t *cond)
+{
+    pthread_mutex_lock(&pipe_lock);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&pipe_lock);
+}
+
+/* Get the next free slot, waiting for the consumer if necessary */
+static struct pipe_slot *producer_slot(void)
+{
+    size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+
+    if (head - atomic_load(&ring_tail) >= PIPE_RING_SIZE) {
+        pthread_mutex_lock(&pipe_lock);
+        atomic_store(&producer_waiting, WAIT_SPACE);
+        while (head - atomic_load(&ring_tail) >= PIPE_RING_SIZE)
+            pthread_cond_wait(&producer_wake, &pipe_lock);
+        atomic_store(&producer_waiting, WAIT_NONE);
+        pthread_mutex_unlock(&pipe_lock);
+    }
+
+    return &ring[head & PIPE_RING_MASK];
+}
+
+/*
+ * Make the slot returned by producer_slot() visible to the consumer.
+ * Unless forced, a sleeping consumer is only woken up once a batch of
+ * lines is available, to avoid bouncing between the threads.
+ */
+static void producer_publish(bool force)
+{
+    size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed) + 1;
+
+    atomic_store(&ring_head, head);
+    if (atomic_load(&consumer_sleeping) &&
+        (force || head - atomic_load(&ring_tail) >= PIPE_BATCH))
+        wake(&consumer_wake);
+}
+
+/* Wait until the consumer has processed every line published so far */
+static void producer_sync(void)
+{
+    size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+
+    pthread_mutex_lock(&pipe_lock);
+    atomic_store(&producer_waiting, WAIT_SYNC);
+    pthread_cond_signal(&consumer_wake);
+    while (atomic_load(&ring_tail) != head || !atomic_load(&consumer_sleeping))
+        pthread_cond_wait(&producer_wake, &pipe_lock);
+    atomic_store(&producer_waiting, WAIT_NONE);
+    pthread_mutex_unlock(&pipe_lock);
+}
+
+static void consumer_wait(size_t tail)
+{
+    pthread_mutex_lock(&pipe_lock);
+    atomic_store(&consumer_sleeping, true);
+    if (atomic_load(&producer_waiting) != WAIT_NONE)
+        pthread_cond_signal(&producer_wake);
+    while (atomic_load(&ring_head) == tail)
+        pthread_cond_wait(&consumer_wake, &pipe_lock);
+    atomic_store(&consumer_sleeping, false);
+    pthread_mutex_unlock(&pipe_lock);
+}
+
+static void producer_put(char *line)
+{
+    struct pipe_slot *slot = producer_slot();
+
+    slot->line   = line;
+    slot->errors = nasm_error_take_deferred();
+    src_save_stack(&slot->where);
+    producer_publish(!line);
+}
+
+static void *producer_main(void *arg)
+{
+    char *line;
+
+    (void)arg;
+
+    pipe_role = PIPE_PRODUCER;
+    TRACE_THREAD("preprocessor");
+    src_init();
+    src_update(producer_start);
+
+    do {
+        line = pp_getline();
+        producer_put(line);
+    } while (line);
+
+    eval_cleanup();
+    return NULL;
+}
+
+bool pipe_start(bool want)
+{
+    bool feedback = feedback_seen;
+    pthread_attr_t attr;
+    size_t stack;
+    int err;
+
+    feedback_seen = false;
+    if (!want || feedback)
+        return false;
+
+    nasm_newn(ring, PIPE_RING_SIZE);
+    atomic_store(&ring_head, 0);
+    atomic_store(&ring_tail, 0);
+    consumer_holding = false;
+    producer_start = src_where();
+    pipe_role = PIPE_CONSUMER;
+
+    /* Give the preprocessor as much stack as it would have had */
+    stack = nasm_get_stack_size_limit();
+    if (stack > PIPE_STACK_MAX)
+        stack = PIPE_STACK_MAX;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack); /* Keep the default on failure */
+    err = pthread_create(&producer_thread, &attr, producer_main, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err) {
+        /* Just run in lockstep, then */
+        nasm_free(ring);
+        ring = NULL;
+        pipe_role = PIPE_LOCKSTEP;
+        return false;
+    }
+
+    return true;
+}
+
+char *pipe_getline(void)
+{
+    struct pipe_slot *slot;
+    size_t tail;
+
+    if (pipe_role != PIPE_CONSUMER)
+        return pp_getline();
+
+    tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    if (consumer_holding) {
+        /* Done with the previous line */
+        atomic_store(&ring_tail, ++tail);
+        if (atomic_load(&producer_waiting) == WAIT_SPACE &&
+            atomic_load(&ring_head) - tail <= PIPE_RING_SIZE/2)
+            wake(&producer_wake);
+    }
+
+    if (atomic_load(&ring_head) == tail)
+        consumer_wait(tail);
+
+    slot = &ring[tail & PIPE_RING_MASK];
+    consumer_holding = true;
+
+    src_load_stack(&slot->where);
+    nasm_error_issue_deferred(slot->errors);
+    slot->errors = NULL;
+
+    return slot->line;
+}
+
+void pipe_finish(void)
+{
+    struct src_location where;
+    size_t i;
+
+    if (pipe_role != PIPE_CONSUMER)
+        return;
+
+    pthread_join(producer_thread, NULL);
+
+    /* The loaded location stack points into the ring; make it our own */
+    where = src_where_top();
+    src_init();
+    src_update(where);
+
+    for (i = 0; i < PIPE_RING_SIZE; i++)
+        src_free_saved_stack(&ring[i].where);
+    nasm_free(ring);
+    ring = NULL;
+
+    pipe_role = PIPE_LOCKSTEP;
+}
+
+void pipe_feedback(void)
+{
+    if (pipe_role == PIPE_PRODUCER)
+        producer_sync();
+    else
+        feedback_seen = true;
+}
+
+fatal_func pipe_abort(void)
+{
+    producer_put(NULL);
+    pthread_exit(NULL);
+}
+
+#else /* !HAVE_THREADS */
+
+bool pipe_start(bool want)
+{
+    (void)want;
+
+    feedback_seen = false;
+    return false;
+}
+
+char *pipe_getline(void)
+{
+    return pp_getline();
+}
+
+void pipe_finish(void)
+{
+}
+
+void pipe_feedback(void)
+{
+    feedback_seen = true;
+}
+
+fatal_func pipe_abort(void)
+{
+    panic();
+}
+
+#endif /* HAVE_THREADS */
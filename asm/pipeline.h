@@ -0,0 +1,79 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * pipeline.h - run the preprocessor on its own thread in the final pass
+ */
+
+#ifndef NASM_PIPELINE_H
+#define NASM_PIPELINE_H
+
+#include "compiler.h"
+
+enum pipe_role {
+    PIPE_LOCKSTEP,              /* Everything runs on a single thread */
+    PIPE_PRODUCER,              /* The preprocessor thread */
+    PIPE_CONSUMER               /* The assembler (main) thread */
+};
+extern thread_local_var enum pipe_role pipe_role;
+
+/*
+ * Called at the start of each pass, after pp_reset(). If "want" is
+ * set and pipelining is possible, starts the preprocessor thread and
+ * returns true; otherwise everything runs in lockstep.
+ */
+bool pipe_start(bool want);
+
+/* Returns the next line from the preprocessor, pipelined or not */
+char *pipe_getline(void);
+
+/* Wait for the preprocessor thread at the end of the pass */
+void pipe_finish(void);
+
+/*
+ * Called where the preprocessor reads state owned by the assembler
+ * proper, or where the assembler changes state the preprocessor
+ * uses. This prevents pipelining the next pass, and if the
+ * preprocessor is already running ahead, makes it wait for the
+ * assembler to catch up.
+ */
+void pipe_feedback(void);
+
+/*
+ * Called on the preprocessor thread after a fatal error has been
+ * deferred; hands it over to the assembler thread and exits.
+ */
+fatal_func pipe_abort(void);
+
+#endif /* NASM_PIPELINE_H */
@@ -46,6 +46,7 @@
 #include "assemble.h"
 #include "error.h"
 #include "listing.h"
+#include "pipeline.h"
 
 static enum directive_result ignore_pragma(const struct pragma *pragma);
 static enum directive_result output_pragma(const struct pragma *pragma);
@@ -365,5 +366,6 @@ static enum directive_result debug_pragma(const struct pragma *pragma)
  */
 static enum directive_result limit_pragma(const struct pragma *pragma)
 {
+    pipe_feedback();            /* Most limits apply to the preprocessor */
     return nasm_set_limit(pragma->opname, pragma->tail);
 }
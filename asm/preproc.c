@@ -76,6 +76,9 @@
 #include "tables.h"
 #include "listing.h"
 #include "dbginfo.h"
+#include "saa.h"
+#include "pipeline.h"
+#include "trace.h"
 
 /*
  * Preprocessor execution options that can be controlled by %pragma or
@@ -102,6 +105,28 @@ static enum pp_debug_flags {
  */
 static enum preproc_opt ppopt;
 
+/*
+ * Preprocessor statistics, printed by pp_print_stats() (--pp-stats).
+ * The simple event counters are always kept; anything which costs
+ * more than an increment is only done when PP_STATS is set.
+ */
+static struct pp_stats {
+    uint64_t lines_read;        /* Lines read from files and stdmac */
+    uint64_t lines_skipped;     /* Of those, dropped by skip_line() */
+    uint64_t inc_skipped;       /* %includes skipped by an include guard */
+    uint64_t evals_fast;        /* Expressions done by pp_evaluate() itself */
+    uint64_t evals_full;        /* Expressions passed on to evaluate() */
+    uint64_t lines_out;         /* Lines returned by pp_getline() */
+    uint64_t tokens_out;        /* Tokens in those lines */
+    uint64_t smacro_calls;      /* Single-line macro expansions */
+    uint64_t mmacro_calls;      /* Multi-line macro expansions */
+    uint64_t pastes;            /* Token pastes, explicit or implicit */
+    uint64_t tok_alloc;         /* Calls to alloc_Token() */
+    uint64_t tok_free;          /* Calls to delete_Token() */
+    uint64_t tok_peak;          /* Maximum number of live tokens */
+    uint64_t tok_blocks;        /* Blocks of TOKEN_BLOCKSIZE tokens */
+} ppstats;
+
 typedef struct SMacro SMacro;
 typedef struct MMacro MMacro;
 typedef struct Context Context;
@@ -153,10 +178,13 @@ static bool is_smac_param(enum token_type toktype)
 }
 
 /*
- * This is tuned so struct Token should be 64 bytes on 64-bit
- * systems and 32 bytes on 32-bit systems. It enables them
- * to be nicely cache aligned, and the text to still be kept
- * inline for nearly all tokens.
+ * This is tuned so struct Token is 32 bytes, half a cache line on
+ * common hardware: token lists are walked over and over again during
+ * expansion, and the smaller the tokens the more of a line fits in
+ * the cache. The text of nearly all tokens is still kept inline;
+ * longer identifiers and strings go out of line. Only the layout is
+ * tuned: tokens are still allocated one by one, linked by pointer,
+ * and never shared.
  *
  * We prohibit tokens of length > MAX_TEXT even though
  * length here is an unsigned int; this avoids problems
@@ -168,7 +196,7 @@ static bool is_smac_param(enum token_type toktype)
  * is incorrect, as some token types strip parts of the string,
  * e.g. indirect tokens.
  */
-#define INLINE_TEXT (7*sizeof(char *)-sizeof(enum token_type)-sizeof(unsigned int)-1)
+#define INLINE_TEXT (32-sizeof(Token *)-sizeof(enum token_type)-sizeof(unsigned int)-1)
 #define MAX_TEXT (INT_MAX-2)
 
 struct Token {
@@ -306,12 +334,38 @@ struct MMacro {
     int *paramlen;
     uint64_t unique;
     uint64_t condcnt;           /* number of if blocks... */
+    trace_time_t trace_start;   /* start of the expansion, for --trace-events */
     struct {                    /* Debug information */
         struct debug_macro_def *def; /* Definition */
         struct debug_macro_inv *inv; /* Current invocation (if any) */
     } dbg;
 };
 
+/*
+ * All the multi-line macros with the same case-folded name; this is
+ * what the mmacros hash table points to. The overloads are kept in a
+ * list, most recent first, which is also the order of preference.
+ *
+ * Instruction wrapper macro sets can have dozens of overloads of the
+ * same name, so looking one up by parameter count uses an index:
+ * byparam[n] is the first macro in the list accepting n parameters,
+ * and any count >= nbyparam is accepted first by tail, unless the
+ * index had to be truncated. The index is built on demand and
+ * dropped whenever the list changes. It only applies if any macro in
+ * the list matching the invoked name means they all do, i.e. if they
+ * are all case-insensitive or all have exactly the same name.
+ */
+#define MMACRO_INDEX_MAX 64
+
+struct mmacro_set {
+    MMacro *list;
+    MMacro **byparam;           /* NULL if not built */
+    MMacro *tail;               /* For nparam >= nbyparam */
+    int nbyparam;
+    bool truncated;             /* Counts >= nbyparam are not indexed */
+    bool uniform;               /* The index can be used at all */
+};
+
 
 /* Store the definition of a multi-line macro, as defined in a
  * previous recursive macro expansion.
@@ -476,7 +530,19 @@ struct Line {
  * Note: when we issue a message for a continuation line, we want to
  * issue it for the actual *start* of the continuation line. This means
  * we need to remember how many lines to skip over for the next one.
+ *
+ * The guard fields track whether everything in the file outside
+ * comments is a single %ifndef ... %endif block; if so, the name of
+ * the macro tested is recorded in the file hash entry when the file
+ * ends, and the file is not opened again while that macro is defined.
  */
+enum guard_state {
+    GUARD_NONE,                 /* Not (or no longer) an include guard */
+    GUARD_START,                /* Only blank lines seen so far */
+    GUARD_INSIDE,               /* Inside the %ifndef block */
+    GUARD_CLOSED                /* After the %endif of the block */
+};
+
 struct Include {
     Include *next;
     FILE *fp;
@@ -488,6 +554,12 @@ struct Include {
     struct src_location where;  /* Filename and current line number */
     int32_t lineinc;            /* Increment given by %line */
     int32_t lineskip;           /* Accounting for passed continuation lines */
+    trace_time_t trace_start;   /* For --trace-events */
+    const char *trace_name;
+    struct file_hash_entry *fhe; /* File hash entry, if from %include */
+    enum guard_state guard;
+    Cond *guard_cond;           /* The %ifndef of the guard */
+    char *guard_name;           /* The macro it tests */
 };
 
 /*
@@ -651,6 +723,8 @@ static Token *expand_mmac_params(Token * tline);
 static Token *expand_smacro(Token * tline);
 static Token *expand_id(Token * tline);
 static Context *get_ctx(const char *name, const char **namep);
+static bool smacro_defined(Context *ctx, const char *name, int nparam,
+                           SMacro **defn, bool nocase, bool find_alias);
 static Token *make_tok_num(Token *next, int64_t val);
 static Token *
 make_tok_num_radix(Token *next, int64_t val, char radix, bool uns);
@@ -993,6 +1067,16 @@ static void free_mmacro(MMacro * m)
     nasm_free(m);
 }
 
+/*
+ * Drop the parameter count index of a multi-line macro set, after
+ * its list of macros has changed
+ */
+static void mmacro_set_changed(struct mmacro_set *set)
+{
+    nasm_free(set->byparam);
+    set->byparam = NULL;
+}
+
 /*
  * Clear or free an SMacro
  */
@@ -1085,10 +1169,13 @@ static void free_mmacro_table(struct hash_table *mmt)
 
     hash_for_each(mmt, it, np) {
         MMacro *tmp;
-        MMacro *m = np->data;
+        struct mmacro_set *set = np->data;
+        MMacro *m = set->list;
         nasm_free((void *)np->key);
         list_for_each_safe(m, tmp, m)
             free_mmacro(m);
+        nasm_free(set->byparam);
+        nasm_free(set);
     }
     hash_free(mmt);
 }
@@ -1319,12 +1406,87 @@ static char *read_line(void)
     if (!line)
         return NULL;
 
+    ppstats.lines_read++;
+
     if (!istk->nolist)
         lfmt->line(LIST_READ, istk->where.lineno, line);
 
     return line;
 }
 
+/*
+ * In a non-emitting branch of a condition, do_directive() only acts
+ * on condition directives and line directives; everything else is
+ * thrown away. Check if a line just read from a file can be neither,
+ * so that it can be dropped without tokenizing it: only a leading
+ * %identifier (or a leading # or %{...}, to be safe) can be.
+ *
+ * While defining a macro, lines are kept whatever the state, and in
+ * TASM mode directives don't need a %, so skip nothing then.
+ */
+static bool skip_line(char *line)
+{
+    char *p, *ep, c;
+    enum preproc_token op;
+
+    if (!istk->conds || emitting(istk->conds->state) || defining ||
+        (ppopt & PP_TASM))
+        return false;
+
+    if (*line == '#')
+        return false;           /* Possibly a cpp-style line directive */
+
+    p = nasm_skip_spaces(line);
+    if (*p != '%')
+        goto skip;
+
+    if (p[1] == '{')
+        return false;
+
+    /* The same quick test as in do_directive() */
+    if (!nasm_isidchar(p[1]) || (uint8_t)(p[1] - 'A') > (uint8_t)('z' - 'A'))
+        goto skip;
+
+    ep = nasm_skip_idchars(p + 2);
+    c = *ep;
+    *ep = '\0';
+    op = pp_token_hash(p);
+    *ep = c;
+
+    if (op == PP_invalid)
+        goto skip;
+    if (op == PP_LINE)
+        return false;
+    if (PP_HAS_CASE(op) & PP_INSENSITIVE(op))
+        op--;
+    if (is_condition(op))
+        return false;
+
+skip:
+    ppstats.lines_skipped++;
+    return true;
+}
+
+/*
+ * Track the include guard state of the current file for a line read
+ * from it: outside the guard block, only blank lines and comments are
+ * allowed. The %ifndef itself and the matching %endif are recognized
+ * by do_directive().
+ */
+static void guard_line(Token *tline)
+{
+    const Token *t = skip_white(tline);
+
+    if (!t)
+        return;
+
+    if (istk->guard == GUARD_START && tok_is(t, TOKEN_PREPROC_ID) &&
+        pp_token_hash(tok_text(t)) == PP_IFNDEF)
+        return;
+
+    istk->guard = GUARD_NONE;
+}
+
 /*
  * Tokenize a line of text. This is a very simple process since we
  * don't need to parse the value out of e.g. numeric tokens: we
@@ -1412,10 +1574,7 @@ static Token *tokenize(const char *line)
                 /* Environment variable reference */
                 p++;
                 if (nasm_isidchar(*p)) {
-                    do {
-                        p++;
-                    }
-                    while (nasm_isidchar(*p));
+                    p = nasm_skip_idchars(p + 1);
                 } else if (nasm_isquote(*p)) {
                     p = nasm_skip_string(p);
                     if (*p)
@@ -1431,10 +1590,7 @@ static Token *tokenize(const char *line)
             } else if (nasm_isidchar(*p) ||
                        ((*p == '%' || *p == '$') && nasm_isidchar(p[1]))) {
                 /* Identifier or some sort */
-                do {
-                    p++;
-                }
-                while (nasm_isidchar(*p));
+                p = nasm_skip_idchars(p + 1);
             } else if (*p == '%') {
                 /* %% operator */
                 p++;
@@ -1542,8 +1698,7 @@ static Token *tokenize(const char *line)
              * special to the preprocessor.
              */
             type = TOKEN_ID;
-            while (nasm_isidchar(*++p))
-                ;
+            p = nasm_skip_idchars(p + 1);
          } else if (nasm_isquote(*p)) {
             /*
              * A string token.
@@ -1775,11 +1930,17 @@ static Token *alloc_Token(void)
 {
     Token *t = freeTokens;
 
+    ppstats.tok_alloc++;
+    if (unlikely(ppopt & PP_STATS) &&
+        ppstats.tok_alloc - ppstats.tok_free > ppstats.tok_peak)
+        ppstats.tok_peak = ppstats.tok_alloc - ppstats.tok_free;
+
     if (unlikely(!t)) {
         Token *block;
         size_t i;
 
         nasm_newn(block, TOKEN_BLOCKSIZE);
+        ppstats.tok_blocks++;
 
         /*
          * The first entry in each array are a linked list of
@@ -1814,7 +1975,10 @@ static Token *delete_Token(Token *t)
 
     nasm_assert(t && t->type != TOKEN_FREE);
 
+    ppstats.tok_free++;
     next = t->next;
+    if (t->len > INLINE_TEXT)
+        nasm_free(t->text.p.ptr);
     nasm_zero(*t);
     t->type = TOKEN_FREE;
     t->next = freeTokens;
@@ -1839,12 +2003,19 @@ static inline Token *alloc_Token(void)
 {
     Token *t;
     nasm_new(t);
+    ppstats.tok_alloc++;
+    if (unlikely(ppopt & PP_STATS) &&
+        ppstats.tok_alloc - ppstats.tok_free > ppstats.tok_peak)
+        ppstats.tok_peak = ppstats.tok_alloc - ppstats.tok_free;
     return t;
 }
 
 static Token *delete_Token(Token *t)
 {
     Token *next = t->next;
+    ppstats.tok_free++;
+    if (t->len > INLINE_TEXT)
+        nasm_free(t->text.p.ptr);
     nasm_free(t);
     return next;
 }
@@ -2084,12 +2255,25 @@ static int ppscan(void *private_data, struct tokenval *tokval)
     tokval->t_charptr = (char *)txt; /* Fix this */
 
     switch (tline->type) {
+    case TOKEN_HERE:
+    case TOKEN_BASE:
+        /* The evaluator reads the current assembly position */
+        pipe_feedback();
+        return tokval->t_type = tline->type;
+
     default:
         return tokval->t_type = tline->type;
 
     case TOKEN_ID:
+    {
         /* This could be an assembler keyword */
-	return nasm_token_hash(txt, tokval);
+        int t = nasm_token_hash_len(txt, tline->len, tokval);
+
+        /* Labels, and floating-point state set by the [float] directive */
+        if (t == TOKEN_ID || t == TOKEN_FLOATIZE)
+            pipe_feedback();
+	return t;
+    }
 
     case TOKEN_NUM:
     {
@@ -2111,6 +2295,321 @@ static int ppscan(void *private_data, struct tokenval *tokval)
     }
 }
 
+/*
+ * Fast path for pp_evaluate(): most expressions in preprocessor
+ * directives, like the %assign i i+1 of a %rep loop, are made up only
+ * of numbers and operators once single-line macros have been expanded.
+ * Those are evaluated here, directly on the token list, following the
+ * grammar and the 64-bit arithmetic of evaluate() exactly. Anything
+ * else -- symbols, $, functions, WRT, and anything that would make
+ * evaluate() issue a diagnostic -- makes the fast path give up, and
+ * the expression is then handed to evaluate() from the start.
+ */
+struct ppeval {
+    Token *tok;                 /* Current token */
+    Token *next;                /* The token after it */
+    int type;                   /* Type of the current token */
+    int64_t deadman;
+};
+
+static void ppe_scan(struct ppeval *pe)
+{
+    Token *t = skip_white(pe->next);
+
+    pe->tok = t;
+    if (!t) {
+        pe->next = NULL;
+        pe->type = TOKEN_EOS;
+        return;
+    }
+
+    pe->next = t->next;
+    pe->type = t->type;
+    if (t->type == TOKEN_ID && t->len == 1 && *tok_text(t) == '?')
+        pe->type = TOKEN_QMARK; /* ? is a keyword to the evaluator */
+}
+
+static bool ppe_cexpr(struct ppeval *pe, int64_t *v);
+
+static bool ppe_expr6(struct ppeval *pe, int64_t *v)
+{
+    Token *t = pe->tok;
+    bool err;
+
+    if (++pe->deadman > nasm_limit[LIMIT_EVAL])
+        return false;
+
+    switch (pe->type) {
+    case '-':
+    case '+':
+    case '~':
+    case '!':
+    {
+        const int op = pe->type;
+
+        ppe_scan(pe);
+        if (!ppe_expr6(pe, v))
+            return false;
+        if (op == '-')
+            *v = -(uint64_t)*v;
+        else if (op == '~')
+            *v = ~*v;
+        else if (op == '!')
+            *v = !*v;
+        return true;
+    }
+
+    case '(':
+        ppe_scan(pe);
+        if (!ppe_cexpr(pe, v) || pe->type != ')')
+            return false;
+        break;
+
+    case TOKEN_NUM:
+    {
+        const char *p = tok_text(t);
+        size_t len = t->len;
+
+        /*
+         * Leave numbers which might not fit in 64 bits to evaluate(),
+         * so the warning for them is not issued twice: at most 16
+         * characters can't hold more than 16 hex digits, and at most
+         * 19 decimal digits always fit.
+         */
+        if (len > 16) {
+            if (*p == '-')
+                p++, len--;
+            if (len > 19 || strspn(p, "0123456789") != len)
+                return false;
+        }
+        *v = readnum(tok_text(t), &err);
+        if (err)
+            return false;
+        break;
+    }
+
+    case TOKEN_STR:
+    case TOKEN_INTERNAL_STR:
+    case TOKEN_NAKED_STR:
+        unquote_token(t);
+        if (t->len > 8)
+            return false;       /* "character constant too long" */
+        *v = readstrnum((char *)tok_text(t), t->len, &err);
+        break;
+
+    default:
+        return false;
+    }
+
+    ppe_scan(pe);
+    return true;
+}
+
+/* Binding strength of a binary operator, or -1 if it isn't one */
+static int ppe_level(int type)
+{
+    switch (type) {
+    case TOKEN_DBL_OR:
+        return 0;
+    case TOKEN_DBL_XOR:
+        return 1;
+    case TOKEN_DBL_AND:
+        return 2;
+    case TOKEN_EQ:
+    case TOKEN_NE:
+    case TOKEN_LT:
+    case TOKEN_GT:
+    case TOKEN_LE:
+    case TOKEN_GE:
+    case TOKEN_LEG:
+        return 3;
+    case '|':
+        return 4;
+    case '^':
+        return 5;
+    case '&':
+        return 6;
+    case TOKEN_SHL:
+    case TOKEN_SHR:
+    case TOKEN_SAR:
+        return 7;
+    case '+':
+    case '-':
+        return 8;
+    case '*':
+    case '/':
+    case '%':
+    case TOKEN_SDIV:
+    case TOKEN_SMOD:
+        return 9;
+    default:
+        return -1;
+    }
+}
+
+static bool ppe_binop(int op, int64_t *v, int64_t f)
+{
+    const int64_t e = *v;
+    const uint64_t ue = e, uf = f;
+    int64_t d;
+
+    switch (op) {
+    case TOKEN_DBL_OR:
+        *v = e || f;
+        break;
+    case TOKEN_DBL_XOR:
+        *v = !e ^ !f;
+        break;
+    case TOKEN_DBL_AND:
+        *v = e && f;
+        break;
+    case TOKEN_EQ:
+    case TOKEN_NE:
+    case TOKEN_LT:
+    case TOKEN_GT:
+    case TOKEN_LE:
+    case TOKEN_GE:
+    case TOKEN_LEG:
+        /* evaluate() compares the difference against zero */
+        d = ue - uf;
+        switch (op) {
+        case TOKEN_EQ:
+            *v = !d;
+            break;
+        case TOKEN_NE:
+            *v = !!d;
+            break;
+        case TOKEN_LEG:
+            if (d < 0)
+                return false; /* evaluate() takes -1 to mean unknown */
+            *v = (d > 0);
+            break;
+        default:
+            if (d == 0)
+                *v = (op == TOKEN_LE || op == TOKEN_GE);
+            else if (d > 0)
+                *v = (op == TOKEN_GE || op == TOKEN_GT);
+            else
+                *v = (op == TOKEN_LE || op == TOKEN_LT);
+            break;
+        }
+        break;
+    case '|':
+        *v = e | f;
+        break;
+    case '^':
+        *v = e ^ f;
+        break;
+    case '&':
+        *v = e & f;
+        break;
+    case TOKEN_SHL:
+    case TOKEN_SHR:
+    case TOKEN_SAR:
+        if (uf > 63)
+            return false;       /* Undefined in C; let evaluate() do it */
+        *v = (op == TOKEN_SHL) ? (int64_t)(ue << f) :
+            (op == TOKEN_SHR) ? (int64_t)(ue >> f) : e >> f;
+        break;
+    case '+':
+        *v = ue + uf;
+        break;
+    case '-':
+        *v = ue - uf;
+        break;
+    case '*':
+        *v = ue * uf;
+        break;
+    default:
+        /* Division: leave division by zero and overflow to evaluate() */
+        if (!f || ((op == TOKEN_SDIV || op == TOKEN_SMOD) &&
+                   e == INT64_MIN && f == -1))
+            return false;
+        *v = (op == '/') ? (int64_t)(ue / uf) :
+            (op == '%') ? (int64_t)(ue % uf) :
+            (op == TOKEN_SDIV) ? e / f : e % f;
+        break;
+    }
+    return true;
+}
+
+/*
+ * Parse the binary operators binding at least as strongly as minlevel
+ * following the operand in *v, by precedence climbing; all of them
+ * are left associative.
+ */
+static bool ppe_binary(struct ppeval *pe, int minlevel, int64_t *v)
+{
+    int64_t f;
+    int op, level;
+
+    while ((level = ppe_level(pe->type)) >= minlevel) {
+        op = pe->type;
+        ppe_scan(pe);
+        if (!ppe_expr6(pe, &f))
+            return false;
+        while (ppe_level(pe->type) > level) {
+            if (!ppe_binary(pe, level+1, &f))
+                return false;
+        }
+        if (!ppe_binop(op, v, f))
+            return false;
+    }
+    return true;
+}
+
+static bool ppe_cexpr(struct ppeval *pe, int64_t *v)
+{
+    int64_t f, g;
+
+    if (!ppe_expr6(pe, v) || !ppe_binary(pe, 0, v))
+        return false;
+
+    if (pe->type == TOKEN_QMARK) {
+        ppe_scan(pe);
+        if (!ppe_cexpr(pe, &f) || pe->type != ':')
+            return false;
+        ppe_scan(pe);
+        if (!ppe_cexpr(pe, &g))
+            return false;
+        *v = *v ? f : g;
+    }
+    return true;
+}
+
+/*
+ * Evaluate an expression in a preprocessor directive; a drop-in
+ * replacement for evaluate(ppscan, pps, tokval, NULL, true, NULL).
+ * The fast path handles expressions which end at the end of the line
+ * or at a comma; the result is then returned in a static vector.
+ */
+static expr *pp_evaluate(struct ppscan *pps, struct tokenval *tokval)
+{
+    static expr result[2];
+    struct ppeval pe;
+    int64_t v;
+
+    if (pps->ntokens < 0 && tokval->t_type == TOKEN_INVALID) {
+        pe.next = pps->tptr;
+        pe.deadman = 0;
+        ppe_scan(&pe);
+        if (ppe_cexpr(&pe, &v) &&
+            (pe.type == TOKEN_EOS || pe.type == TOKEN_COMMA)) {
+            ppstats.evals_fast++;
+            pps->tptr = pe.next;
+            if (pe.type == TOKEN_EOS)
+                pps->ntokens = 0;
+            tokval->t_type = pe.type;
+            result[0].type  = EXPR_SIMPLE;
+            result[0].value = v;
+            return result;
+        }
+    }
+
+    ppstats.evals_full++;
+    return evaluate(ppscan, pps, tokval, NULL, true, NULL);
+}
+
 /*
  * 1. An expression (true if nonzero 0)
  * 2. The keywords true, on, yes for true
@@ -2147,7 +2646,7 @@ static bool pp_get_boolean_option(Token *tline, bool defval)
     pps.tptr = tline;
     pps.ntokens = -1;
     tokval.t_type = TOKEN_INVALID;
-    evalresult = evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+    evalresult = pp_evaluate(&pps, &tokval);
 
     if (!evalresult)
         return true;
@@ -2297,11 +2796,30 @@ struct file_hash_entry {
     const char *path;
     struct file_hash_entry *full; /* Hash entry for the full path */
     int64_t include_pass; /* Pass in which last included (for %require) */
+    char *guard;          /* Include guard macro, if any */
 };
 
+/*
+ * Is the include guard recorded for a file still defined? This is the
+ * same test %ifndef would make, so if it is, including the file again
+ * would do nothing but read and skip every line of it. Don't skip
+ * the file if that would show in the listing or the debug info.
+ */
+static bool inc_guarded(const struct file_hash_entry *fhe)
+{
+    SMacro *smac;
+
+    if (!fhe->guard || list_active() || (ppdbg & PDBG_INCLUDE))
+        return false;
+
+    return smacro_defined(NULL, fhe->guard, -1, &smac, true, false) &&
+        smac && !smac->alias;
+}
+
 static FILE *inc_fopen(const char *file,
                        struct strlist *dhead,
                        const char **found_path,
+                       struct file_hash_entry **found_fhe,
                        enum incopen_mode omode,
                        enum file_flags fmode)
 {
@@ -2320,6 +2838,12 @@ static FILE *inc_fopen(const char *file,
             path = fhe->path;
             skip_open |= (omode == INC_REQUIRED) &&
                 (fhe->full->include_pass >= pass);
+            if (!skip_open && omode <= INC_REQUIRED &&
+                inc_guarded(fhe->full)) {
+                skip_open = true;
+                fhe->full->include_pass = pass;
+                ppstats.inc_skipped++;
+            }
         }
     } else {
         /* Need to do the actual path search */
@@ -2371,10 +2895,10 @@ static FILE *inc_fopen(const char *file,
         strlist_add(dhead, path ? path : file);
     }
 
-    if (path && !fp && omode != INC_PROBE)
+    if (path && !fp && !skip_open)
         fp = nasm_open_read(path, fmode);
 
-    if (omode < INC_OPTIONAL && !fp) {
+    if (omode < INC_OPTIONAL && !fp && !skip_open) {
         if (!path)
             errno = ENOENT;
 
@@ -2387,6 +2911,8 @@ static FILE *inc_fopen(const char *file,
 
     if (found_path)
         *found_path = path;
+    if (found_fhe)
+        *found_fhe = fp ? fhe->full : NULL;
 
     return fp;
 }
@@ -2398,7 +2924,7 @@ static FILE *inc_fopen(const char *file,
  */
 FILE *pp_input_fopen(const char *filename, enum file_flags mode)
 {
-    return inc_fopen(filename, NULL, NULL, INC_OPTIONAL, mode);
+    return inc_fopen(filename, NULL, NULL, NULL, INC_OPTIONAL, mode);
 }
 
 /*
@@ -2701,6 +3227,7 @@ static enum cond_state if_condition(Token * tline, enum preproc_token ct)
     {
         bool found = false;
         MMacro searching, *mmac;
+        struct mmacro_set *mset;
 
         tline = skip_white(tline);
         tline = expand_id(tline);
@@ -2742,7 +3269,8 @@ static enum cond_state if_condition(Token * tline, enum preproc_token ct)
             tline = tline->next;
             searching.plus = true;
         }
-        mmac = (MMacro *) hash_findix(&mmacros, searching.name);
+        mset = (struct mmacro_set *) hash_findix(&mmacros, searching.name);
+        mmac = mset ? mset->list : NULL;
         while (mmac) {
             if (!strcmp(mmac->name, searching.name) &&
                 (mmac->nparam_min <= searching.nparam_max
@@ -2804,7 +3332,7 @@ iftype:
         pps.tptr = tline = expand_smacro(tline);
 	pps.ntokens = -1;
         tokval.t_type = TOKEN_INVALID;
-        evalresult = evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+        evalresult = pp_evaluate(&pps, &tokval);
         if (!evalresult)
             return -1;
         if (tokval.t_type) {
@@ -3591,8 +4119,11 @@ static void do_clear(enum clear_what what, bool context)
     } else {
         if (what & CLEAR_ALLDEFINE)
             clear_smacro_table(&smacros, what);
-        if (what & CLEAR_MMACRO)
+        if (what & CLEAR_MMACRO) {
+            /* The assembler may still refer to them in error messages */
+            pipe_feedback();
             free_mmacro_table(&mmacros);
+        }
     }
 }
 
@@ -3706,7 +4237,7 @@ static void assign_smacro(const char *mname, bool casesense,
     pps.tptr = tline;
     pps.ntokens = -1;
     tokval.t_type = TOKEN_INVALID;
-    evalresult = evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+    evalresult = pp_evaluate(&pps, &tokval);
     free_tlist(tline);
     if (!evalresult)
         return;
@@ -3807,7 +4338,7 @@ static Token *pp_substr(Token *tline, const char *dname)
 
     pps.ntokens = -1;
     tokval.t_type = TOKEN_INVALID;
-    evalresult = evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+    evalresult = pp_evaluate(&pps, &tokval);
     if (!evalresult) {
         goto err;
     } else if (!is_simple(evalresult)) {
@@ -3821,7 +4352,7 @@ static Token *pp_substr(Token *tline, const char *dname)
         count = 1;  /* Backwards compatibility: one character */
     } else {
         tokval.t_type = TOKEN_INVALID;
-        evalresult = evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+        evalresult = pp_evaluate(&pps, &tokval);
         if (!evalresult) {
             goto err;
         } else if (!is_simple(evalresult)) {
@@ -3890,7 +4421,8 @@ static int do_directive(Token *tline, Token **output)
     Include *inc;
     Context *ctx;
     Cond *cond;
-    MMacro *mmac, **mmhead;
+    MMacro *mmac;
+    struct mmacro_set *mset, **msetp;
     Token *t = NULL, *tt, *macro_start, *last, *origline;
     Line *l;
     struct tokenval tokval;
@@ -4321,7 +4853,7 @@ static int do_directive(Token *tline, Token **output)
         nasm_new(inc);
         inc->next = istk;
         found_path = NULL;
-        inc->fp = inc_fopen(p, deplist, &found_path,
+        inc->fp = inc_fopen(p, deplist, &found_path, &inc->fhe,
                             (pp_mode == PP_DEPS) ? INC_OPTIONAL :
                             (op == PP_REQUIRE) ? INC_REQUIRED :
                             INC_NEEDED, NF_TEXT);
@@ -4333,7 +4865,10 @@ static int do_directive(Token *tline, Token **output)
             inc->noline  = istk->noline;
             inc->where   = istk->where;
             inc->lineinc = 0;
+            inc->guard   = GUARD_START;
             istk = inc;
+            inc->trace_name = found_path;
+            TRACE_BEGIN(inc->trace_start);
             if (!istk->noline) {
                 src_set(0, found_path ? found_path : p);
                 istk->where = src_where();
@@ -4371,6 +4906,8 @@ static int do_directive(Token *tline, Token **output)
                 inc->noline++;
             }
             istk = inc;
+            inc->trace_name = pkg->package;
+            TRACE_BEGIN(inc->trace_start);
             if (!istk->nolist)
                 lfmt->uplevel(LIST_INCLUDE, 0);
             if (!inc->noline)
@@ -4463,6 +5000,16 @@ issue_error:
     }
 
     CASE_PP_IF:
+        if (istk->guard == GUARD_START) {
+            /* The first line of the file; is it %ifndef macro? */
+            istk->guard = GUARD_NONE;
+            t = skip_white(tline->next);
+            if (op == PP_IFNDEF && !istk->mstk.mstk &&
+                tok_is(t, TOKEN_ID) && !skip_white(t->next)) {
+                istk->guard = GUARD_INSIDE;
+                istk->guard_name = nasm_strdup(tok_text(t));
+            }
+        }
         if (istk->conds && !emitting(istk->conds->state))
             j = COND_NEVER;
         else {
@@ -4473,6 +5020,8 @@ issue_error:
         cond->next = istk->conds;
         cond->state = j;
         istk->conds = cond;
+        if (istk->guard == GUARD_INSIDE && !istk->guard_cond)
+            istk->guard_cond = cond;
         if(istk->mstk.mstk)
             istk->mstk.mstk->condcnt++;
         break;
@@ -4482,6 +5031,8 @@ issue_error:
             nasm_nonfatal("`%s': no matching `%%if'", dname);
             break;
         }
+        if (istk->conds == istk->guard_cond)
+            istk->guard = GUARD_NONE;
         switch(istk->conds->state) {
         case COND_IF_TRUE:
             istk->conds->state = COND_DONE;
@@ -4528,6 +5079,8 @@ issue_error:
 	    nasm_nonfatal("`%s': no matching `%%if'", dname);
             break;
         }
+        if (istk->conds == istk->guard_cond)
+            istk->guard = GUARD_NONE;
         switch(istk->conds->state) {
         case COND_IF_TRUE:
         case COND_DONE:
@@ -4567,6 +5120,11 @@ issue_error:
         }
         cond = istk->conds;
         istk->conds = cond->next;
+        if (cond == istk->guard_cond) {
+            istk->guard_cond = NULL;
+            if (istk->guard == GUARD_INSIDE)
+                istk->guard = istk->mstk.mstk ? GUARD_NONE : GUARD_CLOSED;
+        }
         nasm_free(cond);
         if(istk->mstk.mstk)
             istk->mstk.mstk->condcnt--;
@@ -4597,7 +5155,8 @@ issue_error:
         defining = def;
         defining->where = istk->where;
 
-        mmac = (MMacro *) hash_findix(&mmacros, defining->name);
+        mset = (struct mmacro_set *) hash_findix(&mmacros, defining->name);
+        mmac = mset ? mset->list : NULL;
         while (mmac) {
             if (!strcmp(mmac->name, defining->name) &&
                 (mmac->nparam_min <= defining->nparam_max
@@ -4626,9 +5185,13 @@ issue_error:
             nasm_nonfatal("`%s': not defining a macro", tok_text(tline));
             goto done;
         }
-        mmhead = (MMacro **) hash_findi_add(&mmacros, defining->name);
-        defining->next = *mmhead;
-        *mmhead = defining;
+        msetp = (struct mmacro_set **) hash_findi_add(&mmacros, defining->name);
+        if (!*msetp)
+            *msetp = nasm_zalloc(sizeof(struct mmacro_set));
+        mset = *msetp;
+        defining->next = mset->list;
+        mset->list = defining;
+        mmacro_set_changed(mset);
         defining = NULL;
         break;
 
@@ -4675,12 +5238,14 @@ issue_error:
         if (!parse_mmacro_spec(tline, &spec, dname)) {
             goto done;
         }
-        mmac_p = (MMacro **) hash_findi(&mmacros, spec.name, NULL);
-        if (!mmac_p) {
+        msetp = (struct mmacro_set **) hash_findi(&mmacros, spec.name, NULL);
+        if (!msetp) {
             /* No such macro */
             free_tlist(spec.dlist);
             break;
         }
+        mset = *msetp;
+        mmac_p = &mset->list;
 
         /* Check the macro to be undefined is not being expanded */
         list_for_each(l, istk->expansion) {
@@ -4694,6 +5259,9 @@ issue_error:
             }
         }
 
+        /* The assembler may still refer to it in error messages */
+        pipe_feedback();
+
         while (mmac_p && *mmac_p) {
             mmac = *mmac_p;
             if (mmac->casesense == spec.casesense &&
@@ -4703,6 +5271,7 @@ issue_error:
                 mmac->plus == spec.plus) {
                 *mmac_p = mmac->next;
                 free_mmacro(mmac);
+                mmacro_set_changed(mset);
             } else {
                 mmac_p = &mmac->next;
             }
@@ -4725,7 +5294,7 @@ issue_error:
 	pps.ntokens = -1;
         tokval.t_type = TOKEN_INVALID;
         evalresult =
-            evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+            pp_evaluate(&pps, &tokval);
         free_tlist(tline);
         if (!evalresult)
             return DIRECTIVE_FOUND;
@@ -4772,7 +5341,7 @@ issue_error:
             tokval.t_type = TOKEN_INVALID;
             /* XXX: really critical?! */
             evalresult =
-                evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+                pp_evaluate(&pps, &tokval);
             if (!evalresult)
                 goto done;
             if (tokval.t_type)
@@ -5006,7 +5575,7 @@ issue_error:
 
 	p = unquote_token_cstr(t);
 
-        inc_fopen(p, NULL, &found_path, INC_PROBE, NF_BINARY);
+        inc_fopen(p, NULL, &found_path, NULL, INC_PROBE, NF_BINARY);
         if (!found_path)
             found_path = p;
 	macro_start = make_tok_qstr(NULL, found_path);
@@ -5201,6 +5770,79 @@ static inline bool pp_concat_match(const Token *t, enum concat_flags mask)
     return !!(ctype & mask);
 }
 
+/*
+ * Scratch buffer for the text of pasted tokens, kept between pastes
+ */
+static char *paste_buf;
+static size_t paste_bufsize;
+
+static char *get_paste_buf(size_t len)
+{
+    if (unlikely(len >= paste_bufsize)) {
+        paste_bufsize = (len + 64) & ~(size_t)63;
+        nasm_free(paste_buf);
+        paste_buf = nasm_malloc(paste_bufsize);
+    }
+    return paste_buf;
+}
+
+/*
+ * Nearly all pastes produce a single identifier or number. Tell
+ * those apart without the full tokenize(), so the pasted text can
+ * be put back into the first token; return TOKEN_INVALID for
+ * anything else.
+ */
+static enum token_type paste_type(const char *p, size_t len)
+{
+    const char *ep = p + len;
+
+    if (nasm_isidstart(*p) || (*p == '$' && nasm_isidstart(p[1]))) {
+        if (*p == '?' && !nasm_isidchar(p[1]))
+            return TOKEN_INVALID; /* ? operator */
+        if (nasm_skip_idchars(p + 1) == ep)
+            return TOKEN_ID;
+    } else if (nasm_isdigit(*p)) {
+        while (p < ep && nasm_isdigit(*p))
+            p++;
+        if (p == ep)
+            return TOKEN_NUM;
+    }
+    return TOKEN_INVALID;
+}
+
+/*
+ * Put the pasted text in buf into the token t, or replace t with the
+ * tokens it makes up. Returns the first token of the result; *lastp
+ * is set to the last one.
+ */
+static Token *paste_result(Token *t, const char *buf, size_t len,
+                           Token **lastp)
+{
+    enum token_type type = paste_type(buf, len);
+    Token *last;
+
+    if (likely(type != TOKEN_INVALID)) {
+        set_text(t, buf, len);
+        t->type = type;
+        *lastp = t;
+        return t;
+    }
+
+    delete_Token(t);
+    t = tokenize(buf);
+    if (unlikely(!t)) {
+        /*
+         * No output at all? Replace with a single whitespace.
+         * This should never happen.
+         */
+        t = new_White(NULL);
+    }
+    for (last = t; last->next; last = last->next)
+        ;
+    *lastp = last;
+    return t;
+}
+
 /*
  * This routines walks over tokens stream and handles tokens
  * pasting, if @handle_explicit passed then explicit pasting
@@ -5211,7 +5853,7 @@ static inline bool pp_concat_match(const Token *t, enum concat_flags mask)
 static bool paste_tokens(Token **head, const struct concat_mask *m,
                          size_t mnum, bool handle_explicit)
 {
-    Token *tok, *t, *next, **prev_next, **prev_nonspace, **nextp;
+    Token *tok, *t, *last, *next, **prev_next, **prev_nonspace, **nextp;
     bool pasted = false;
     char *buf, *p;
     size_t len, i;
@@ -5289,25 +5931,12 @@ static bool paste_tokens(Token **head, const struct concat_mask *m,
             }
 
             /* An actual paste */
-            p = buf = nasm_malloc(t->len + next->len + 1);
+            len = t->len + next->len;
+            p = buf = get_paste_buf(len);
             p = mempcpy(p, tok_text(t), t->len);
             p = mempcpy(p, tok_text(next), next->len);
             *p = '\0';
-            delete_Token(t);
-            t = tokenize(buf);
-            nasm_free(buf);
-
-            if (unlikely(!t)) {
-                /*
-                 * No output at all? Replace with a single whitespace.
-                 * This should never happen.
-                 */
-                tok = t = new_White(NULL);
-            } else {
-                *prev_nonspace = tok = t;
-            }
-            while (t->next)
-                t = t->next;    /* Find the last token produced */
+            *prev_nonspace = tok = paste_result(t, buf, len, &t);
 
             /* Delete the second token and attach to the end of the list */
             t->next = delete_Token(next);
@@ -5336,20 +5965,19 @@ static bool paste_tokens(Token **head, const struct concat_mask *m,
             if (len == tok->len)
                 break;
 
-            p = buf = nasm_malloc(len + 1);
-            while (tok != next) {
-                p = mempcpy(p, tok_text(tok), tok->len);
-                tok = delete_Token(tok);
-            }
+            p = buf = get_paste_buf(len);
+            p = mempcpy(p, tok_text(tok), tok->len);
+            for (t = tok->next; t != next; t = delete_Token(t))
+                p = mempcpy(p, tok_text(t), t->len);
             *p = '\0';
-            *prev_next = tok = t = tokenize(buf);
-            nasm_free(buf);
+            *prev_next = tok = t = paste_result(tok, buf, len, &last);
 
             /*
              * Connect pasted into original stream,
              * ie A -> new-tokens -> B
              */
-            while ((tok = t->next)) {
+            while (t != last) {
+                tok = t->next;
                 if (tok->type != TOKEN_WHITESPACE && tok->type != TOKEN_PASTE)
                     prev_nonspace = &t->next;
                 t = tok;
@@ -5363,6 +5991,7 @@ static bool paste_tokens(Token **head, const struct concat_mask *m,
 
         if (did_paste) {
             pasted = true;
+            ppstats.pastes++;
         } else {
             prev_next = &tok->next;
             if (next && next->type != TOKEN_WHITESPACE &&
@@ -5553,6 +6182,7 @@ static Token *expand_mmac_params(Token * tline)
                     if (unlikely(ncc == -1)) {
                         nasm_nonfatal("condition code `%s' is not invertible",
                                       conditions[cc]);
+                        text = NULL;
                         break;
                     }
                     cc = ncc;
@@ -5617,9 +6247,10 @@ static Token *expand_mmac_params(Token * tline)
             if (!text) {
                 delete_Token(t);
             } else {
+                /* Any replacement text here is a fresh allocation */
                 *tail = t;
                 tail = &t->next;
-		set_text(t, text, tok_strlen(text));
+		set_text_free(t, (char *)text, tok_strlen(text));
                 t->type = type;
             }
             changed = true;
@@ -5711,7 +6342,7 @@ expand_smacro_with_params(SMacro *m, Token *mstart, Token **params,
                 pps.tptr = eval_param;
                 pps.ntokens = -1;
                 tokval.t_type = TOKEN_INVALID;
-                evalresult = evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+                evalresult = pp_evaluate(&pps, &tokval);
 
                 free_tlist(eval_param);
 
@@ -6186,6 +6817,7 @@ static SMacro *expand_one_smacro(Token ***tpp)
 
     tafter = tline->next;   /* Skip past the macro call */
     tline->next = NULL;     /* Truncate mstart list at the macro call end */
+    ppstats.smacro_calls++;
     tline = expand_smacro_with_params(m, mstart, params, nparam, &tep);
     if (tline) {
         **tpp = tline;
@@ -6454,6 +7086,84 @@ find_mmacro_in_list(MMacro *m, const char *finding,
     return NULL;
 }
 
+/*
+ * Build the parameter count index of a multi-line macro set.
+ */
+static void build_mmacro_index(struct mmacro_set *set)
+{
+    MMacro *m;
+    const char *name = NULL;
+    bool casesense = false;
+    int n, lim = 0;
+
+    set->uniform = true;
+    list_for_each(m, set->list) {
+        int hi = m->plus ? m->nparam_min : m->nparam_max;
+        if (hi >= lim)
+            lim = hi < MMACRO_INDEX_MAX ? hi + 1 : MMACRO_INDEX_MAX;
+
+        if (!name) {
+            name = m->name;
+            casesense = m->casesense;
+        } else if (m->casesense != casesense ||
+                   (casesense && strcmp(m->name, name))) {
+            set->uniform = false;
+        }
+    }
+
+    set->truncated = false;
+    set->tail = NULL;
+    set->nbyparam = lim;
+    set->byparam = nasm_zalloc(sizeof(MMacro *) * (lim + 1));
+
+    list_for_each(m, set->list) {
+        int hi = m->plus ? m->nparam_min : m->nparam_max;
+        if (hi >= lim)
+            set->truncated = true;
+        if (m->plus || hi >= lim)
+            hi = lim - 1;
+        for (n = m->nparam_min; n <= hi; n++) {
+            if (!set->byparam[n])
+                set->byparam[n] = m;
+        }
+        if (m->plus && !set->tail)
+            set->tail = m;
+    }
+}
+
+/*
+ * Find the multi-line macro to call with nparam parameters using the
+ * set index, starting from m, the first macro of the set which
+ * matches the name and isn't excluded by cycle removal. Fall back to
+ * find_mmacro_in_list() if the index can't answer the question.
+ */
+static MMacro *
+find_mmacro(struct mmacro_set *set, MMacro *m, const char *finding,
+            int *nparamp, Token ***paramsp)
+{
+    int nparam = *nparamp;
+    MMacro *found;
+
+    if (!set->byparam)
+        build_mmacro_index(set);
+
+    if (!set->uniform || (set->truncated && nparam >= set->nbyparam))
+        return find_mmacro_in_list(m, finding, nparamp, paramsp);
+
+    found = nparam < set->nbyparam ? set->byparam[nparam] : set->tail;
+    if (!found)
+        return NULL;
+
+    /*
+     * If the first match is excluded by cycle removal it may come
+     * before m, and then the answer is further down the list.
+     */
+    if (found->in_progress == 1 && found->max_depth <= 0)
+        return find_mmacro_in_list(m, finding, nparamp, paramsp);
+
+    return use_mmacro(found, nparamp, paramsp);
+}
+
 /*
  * Determine whether the given line constitutes a multi-line macro
  * call, and return the MMacro structure called if so. Doesn't have
@@ -6464,7 +7174,8 @@ find_mmacro_in_list(MMacro *m, const char *finding,
  */
 static MMacro *is_mmacro(Token * tline, int *nparamp, Token ***paramsp)
 {
-    MMacro *head, *m, *found;
+    struct mmacro_set *set;
+    MMacro *m, *found;
     Token **params, **comma;
     int raw_nparam, nparam;
     const char *finding = tok_text(tline);
@@ -6473,7 +7184,9 @@ static MMacro *is_mmacro(Token * tline, int *nparamp, Token ***paramsp)
     *nparamp = 0;
     *paramsp = NULL;
 
-    head = (MMacro *) hash_findix(&mmacros, finding);
+    set = (struct mmacro_set *) hash_findix(&mmacros, finding);
+    if (!set)
+        return NULL;
 
     /*
      * Efficiency: first we see if any macro exists with the given
@@ -6485,7 +7198,7 @@ static MMacro *is_mmacro(Token * tline, int *nparamp, Token ***paramsp)
      * count the parameters, and then we look further along the
      * list if necessary to find the proper MMacro.
      */
-    list_for_each(m, head) {
+    list_for_each(m, set->list) {
         if (!mstrcmp(m->name, finding, m->casesense) &&
             (m->in_progress != 1 || m->max_depth > 0))
             break;              /* Found something that needs consideration */
@@ -6508,7 +7221,7 @@ static MMacro *is_mmacro(Token * tline, int *nparamp, Token ***paramsp)
      * encountered an error for which we have already issued a
      * diagnostic, so we should not proceed.
      */
-    found = find_mmacro_in_list(m, finding, nparamp, paramsp);
+    found = find_mmacro(set, m, finding, nparamp, paramsp);
     if (!*paramsp)
         return NULL;
 
@@ -6572,7 +7285,7 @@ static MMacro *is_mmacro(Token * tline, int *nparamp, Token ***paramsp)
                  */
                 int bogus_nparam = 1;
                 params[2] = NULL;
-                found = find_mmacro_in_list(m, finding, &bogus_nparam, paramsp);
+                found = find_mmacro(set, m, finding, &bogus_nparam, paramsp);
             } else if (raw_nparam > 1 && comma) {
                 Token *comma_tail = *comma;
 
@@ -6583,7 +7296,7 @@ static MMacro *is_mmacro(Token * tline, int *nparamp, Token ***paramsp)
                  */
                 *comma = NULL;
                 *nparamp = raw_nparam - 1;
-                found = find_mmacro_in_list(m, finding, nparamp, paramsp);
+                found = find_mmacro(set, m, finding, nparamp, paramsp);
                 if (found)
                     free_tlist(comma_tail);
                 else
@@ -6769,10 +7482,74 @@ debug_macro_get_addr_inv(int32_t seg, struct debug_macro_inv *inv)
     return inv->addr.last = addr;
 }
 
-/* Get/create an addr structure for a seg in debug_current_macro */
-struct debug_macro_addr *debug_macro_get_addr(int32_t seg)
+/*
+ * The output of macros is recorded as a sequence of runs of output
+ * by the same invocation into the same segment, and only turned into
+ * address ranges for each invocation and its parents at the end, so
+ * that the cost per output does not depend on the macro nesting
+ * depth.
+ *
+ * Folding a run into an address range gives the same result as
+ * folding each output in it in turn: the range starts at the first
+ * output which is not empty, or else at the last one, and ends at
+ * the end of the last output.
+ */
+struct debug_macro_run {
+    struct debug_macro_inv *inv;
+    int32_t seg;
+    bool nonempty;              /* Any output with nonzero size? */
+    uint64_t start, end;
+};
+
+static struct SAA *debug_macro_runs;
+static struct debug_macro_run *debug_macro_lastrun;
+
+void debug_macro_add_range(int32_t seg, uint64_t start, uint64_t end)
 {
-    return debug_macro_get_addr_inv(seg, debug_current_macro);
+    struct debug_macro_run *run = debug_macro_lastrun;
+
+    if (likely(run && run->inv == debug_current_macro && run->seg == seg)) {
+        if (!run->nonempty) {
+            run->start = start;
+            run->nonempty = end != start;
+        }
+        run->end = end;
+        return;
+    }
+
+    if (!debug_macro_runs)
+        debug_macro_runs = saa_init(sizeof(struct debug_macro_run));
+
+    debug_macro_lastrun = run = saa_wstruct(debug_macro_runs);
+    run->inv = debug_current_macro;
+    run->seg = seg;
+    run->nonempty = end != start;
+    run->start = start;
+    run->end = end;
+}
+
+/* Build the address ranges of all invocations from the output runs */
+static void debug_macro_build_ranges(void)
+{
+    const struct debug_macro_run *run;
+    struct debug_macro_addr *addr;
+
+    if (!debug_macro_runs)
+        return;
+
+    saa_rewind(debug_macro_runs);
+    while ((run = saa_rstruct(debug_macro_runs))) {
+        addr = debug_macro_get_addr_inv(run->seg, run->inv);
+        while (addr) {
+            if (addr->len) {
+                addr->len = run->end - addr->start;
+            } else {
+                addr->start = run->start;
+                addr->len = run->end - run->start;
+            }
+            addr = addr->up;
+        }
+    }
 }
 
 static struct debug_macro_info dmi;
@@ -6877,10 +7654,17 @@ static void free_debug_macro_info(void)
     free_debug_macro_inv_list(dmi.inv.l);
 
     nasm_zero(dmi);
+
+    if (debug_macro_runs) {
+        saa_free(debug_macro_runs);
+        debug_macro_runs = NULL;
+    }
+    debug_macro_lastrun = NULL;
 }
 
 static void debug_macro_output(void)
 {
+    debug_macro_build_ranges();
     list_reverse(dmi.inv.l);
     dfmt->debug_mmacros(&dmi);
     free_debug_macro_info();
@@ -7041,6 +7825,7 @@ static int expand_mmacro(Token * tline)
     m->paramlen = paramlen;
     m->unique = unique++;
     m->condcnt = 0;
+    TRACE_BEGIN(m->trace_start);
 
     m->mstk = istk->mstk;
     istk->mstk.mstk = istk->mstk.mmac = m;
@@ -7100,6 +7885,7 @@ static int expand_mmacro(Token * tline)
     if (!istk->noline)
         src_macro_push(m, istk->where);
 
+    ppstats.mmacro_calls++;
     return 1;
 }
 
@@ -7155,6 +7941,7 @@ stdmac_bits(const SMacro *s, Token **params, int nparams)
     (void)params;
     (void)nparams;
 
+    pipe_feedback();
     return make_tok_num(NULL, globalbits);
 }
 
@@ -7165,6 +7952,7 @@ stdmac_ptr(const SMacro *s, Token **params, int nparams)
     (void)params;
     (void)nparams;
 
+    pipe_feedback();
     switch (globalbits) {
     case 16:
 	return new_Token(NULL, TOKEN_ID, "word", 4);
@@ -7177,6 +7965,17 @@ stdmac_ptr(const SMacro *s, Token **params, int nparams)
     }
 }
 
+/*
+ * __?PASS?__: the preprocessor output may differ between passes when
+ * this is used, so it counts as feedback.
+ */
+static Token *
+stdmac_pass(const SMacro *s, Token **params, int nparams)
+{
+    pipe_feedback();
+    return smacro_expand_default(s, params, nparams);
+}
+
 /* %is...() function macros */
 static Token *
 stdmac_is(const SMacro *s, Token **params, int nparams)
@@ -7475,7 +8274,7 @@ stdmac_map(const SMacro *s, Token **params, int nparam)
             t->next = NULL;
             pps.ntokens = -1;
             tokval.t_type = TOKEN_INVALID;
-            evalresult = evaluate(ppscan, &pps, &tokval, NULL, true, NULL);
+            evalresult = pp_evaluate(&pps, &tokval);
             free_tlist(ep);
 
             if (!evalresult || tokval.t_type) {
@@ -7731,6 +8530,7 @@ static void pp_reset_stdmac(enum preproc_mode mode)
 {
     int apass;
     struct Include *inc;
+    SMacro tmpl;
 
     /*
      * Set up the stdmac packages as a virtual include file,
@@ -7741,6 +8541,8 @@ static void pp_reset_stdmac(enum preproc_mode mode)
     inc->nolist = inc->noline = !list_option('b');
     inc->where = istk->where;
     istk = inc;
+    inc->trace_name = "standard macros";
+    TRACE_BEGIN(inc->trace_start);
     if (!istk->nolist) {
         lfmt->uplevel(LIST_INCLUDE, 0);
     }
@@ -7770,8 +8572,8 @@ static void pp_reset_stdmac(enum preproc_mode mode)
     /*
      * Define the __?PASS?__ macro.  This is defined here unlike all the
      * other builtins, because it is special -- it varies between
-     * passes -- but there is really no particular reason to make it
-     * magic.
+     * passes.  It has an expansion like an ordinary macro, but is
+     * magic so that its use can be tracked; see stdmac_pass().
      *
      * 0 = dependencies only
      * 1 = preparatory passes
@@ -7792,7 +8594,9 @@ static void pp_reset_stdmac(enum preproc_mode mode)
         panic();
     }
 
-    define_smacro("__?PASS?__", true, make_tok_num(NULL, apass), NULL);
+    nasm_zero(tmpl);
+    tmpl.expand = stdmac_pass;
+    define_smacro("__?PASS?__", true, make_tok_num(NULL, apass), &tmpl);
 }
 
 void pp_reset(const char *file, enum preproc_mode mode,
@@ -7802,6 +8606,7 @@ void pp_reset(const char *file, enum preproc_mode mode,
     defining = NULL;
     nested_mac_count = 0;
     nested_rep_count = 0;
+    nasm_zero(mmacro_deadman);  /* May be left over from an aborted pass */
     init_macros();
     unique = 0;
     deplist = dep_list;
@@ -7838,6 +8643,8 @@ void pp_reset(const char *file, enum preproc_mode mode,
     src_set(0, file);
     istk->where = src_where();
     istk->lineinc = 1;
+    istk->trace_name = file;
+    TRACE_BEGIN(istk->trace_start);
 
     if (ppdbg & PDBG_INCLUDE) {
         /* Let the debug format know the main file */
@@ -7855,6 +8662,7 @@ void pp_reset(const char *file, enum preproc_mode mode,
 void pp_init(enum preproc_opt opt)
 {
     ppopt = opt;
+    nasm_zero(ppstats);
     nasm_newn(use_loaded, use_package_count);
 }
 
@@ -7938,6 +8746,8 @@ static Token *pp_tokline(void)
                      * be freed and the iteration count/nesting
                      * depth adjusted.
                      */
+                    TRACE_END_MIN(m->trace_start, "macro", m->name,
+                                  "line", l->where.lineno);
 
                     if (!--mmacro_deadman.levels) {
                         /*
@@ -8014,22 +8824,44 @@ static Token *pp_tokline(void)
                     nasm_free(line);
                 }
             } else if ((line = read_line())) {
-                tline = tokenize(line);
+                /*
+                 * A skipped line leaves tline NULL, which is
+                 * discarded below like any other line in a
+                 * non-emitting branch.
+                 */
+                if (!skip_line(line))
+                    tline = tokenize(line);
                 nasm_free(line);
+                if (istk->guard == GUARD_START ||
+                    istk->guard == GUARD_CLOSED)
+                    guard_line(tline);
             } else {
                 /*
                  * The current file has ended; work down the istk
                  */
                 Include *i = istk;
 
-                if (i->fp)
+                if (i->fp) {
                     fclose(i->fp);
+                    i->fp = NULL;
+                }
                 if (i->conds) {
                     /* nasm_fatal can't be conditionally suppressed */
                     nasm_fatal("expected `%%endif' before end of file");
                 }
+                if (i->fhe) {
+                    /* Record the include guard, or forget a stale one */
+                    nasm_free(i->fhe->guard);
+                    i->fhe->guard = NULL;
+                    if (i->guard == GUARD_CLOSED) {
+                        i->fhe->guard = i->guard_name;
+                        i->guard_name = NULL;
+                    }
+                }
+                nasm_free(i->guard_name);
 
                 istk = i->next;
+                TRACE_END(i->trace_start, "include", i->trace_name);
 
                 if (!i->nolist)
                     lfmt->downlevel(LIST_INCLUDE);
@@ -8139,6 +8971,14 @@ char *pp_getline(void)
             if (!istk)
                 break;
         } else {
+            ppstats.lines_out++;
+            if (unlikely(ppopt & PP_STATS)) {
+                const Token *t;
+
+                list_for_each(t, tline)
+                    ppstats.tokens_out++;
+            }
+
             /*
              * De-tokenize the line and emit it.
              */
@@ -8177,7 +9017,10 @@ void pp_cleanup_pass(void)
     while (istk) {
         Include *i = istk;
         istk = istk->next;
-        fclose(i->fp);
+        TRACE_END(i->trace_start, "include", i->trace_name);
+        if (i->fp)
+            fclose(i->fp);
+        nasm_free(i->guard_name);
         if (!istk && (ppdbg & PDBG_INCLUDE)) {
             /* Signal closing the top-level input file */
             dfmt->debug_include(false, src_nowhere(), i->where);
@@ -8192,13 +9035,52 @@ void pp_cleanup_pass(void)
         debug_macro_output();
 }
 
+void pp_print_stats(FILE *f)
+{
+#define PRINT_STAT(x) \
+    fprintf(f, "pp-stats: %-13s %"PRIu64"\n", #x, ppstats.x)
+
+    PRINT_STAT(lines_read);
+    PRINT_STAT(lines_skipped);
+    PRINT_STAT(inc_skipped);
+    PRINT_STAT(evals_fast);
+    PRINT_STAT(evals_full);
+    PRINT_STAT(lines_out);
+    PRINT_STAT(tokens_out);
+    PRINT_STAT(smacro_calls);
+    PRINT_STAT(mmacro_calls);
+    PRINT_STAT(pastes);
+    PRINT_STAT(tok_alloc);
+    PRINT_STAT(tok_free);
+    PRINT_STAT(tok_peak);
+    PRINT_STAT(tok_blocks);
+
+#undef PRINT_STAT
+
+    fprintf(f, "pp-stats: %-13s %"PRIu64"\n", "token_size",
+            (uint64_t)sizeof(Token));
+    fprintf(f, "pp-stats: %-13s %d\n", "token_block", TOKEN_BLOCKSIZE);
+}
+
 void pp_cleanup_session(void)
 {
     nasm_free(use_loaded);
+    use_loaded = NULL;
     free_llist(predef);
     predef = NULL;
     delete_Blocks();
+    nasm_free(paste_buf);
+    paste_buf = NULL;
+    paste_bufsize = 0;
     ipath_list = NULL;
+    extrastdmac = NULL;
+    nasm_zero(stdmacros);
+
+    /* Back to the defaults, should another session follow */
+    StackSize = 4;
+    StackPointer = "ebp";
+    ArgOffset = 8;
+    LocalOffset = 0;
 }
 
 void pp_include_path(struct strlist *list)
@@ -41,6 +41,39 @@
 #include "nctype.h"
 #include "error.h"
 
+/*
+ * Can the string be quoted as '...' as it is, i.e. is it all printable
+ * ASCII other than the single quote? This is the common case, and
+ * preprocessor string functions quote and requote the same long
+ * strings many times over, so check eight bytes at a time.
+ */
+#define BYTES(x) (UINT64_C(0x0101010101010101) * (x))
+#define HAS_LESS(w,x) (((w) - BYTES(x)) & ~(w) & BYTES(0x80))
+
+static bool sq_plain(const char *str, size_t len)
+{
+    uint64_t w;
+
+    while (len >= 8) {
+        memcpy(&w, str, 8);
+        /* Any byte >= 0x80, < ' ', DEL or ' ? */
+        if ((w & BYTES(0x80)) | HAS_LESS(w, ' ') |
+            HAS_LESS(w ^ BYTES(0x7f), 1) | HAS_LESS(w ^ BYTES('\''), 1))
+            return false;
+        str += 8;
+        len -= 8;
+    }
+    while (len--) {
+        char c = *str++;
+        if (c < ' ' || c > '~' || c == '\'')
+            return false;
+    }
+    return true;
+}
+
+#undef HAS_LESS
+#undef BYTES
+
 /*
  * Create a NASM quoted string in newly allocated memory. Update the
  * *lenp parameter with the output length (sans final NUL).
@@ -55,6 +88,16 @@ char *nasm_quote(const char *str, size_t *lenp)
     size_t qlen;
     size_t len = *lenp;
 
+    if (sq_plain(str, len)) {
+	nstr = nasm_malloc(len+3);
+	nstr[0] = nstr[len+1] = '\'';
+	if (len > 0)
+	    memcpy(nstr+1, str, len);
+	nstr[len+2] = '\0';
+	*lenp = len+2;
+	return nstr;
+    }
+
     sq_ok = dq_ok = true;
     ep = str+len;
     qlen = 0;			/* Length if we need `...` quotes */
@@ -451,8 +494,18 @@ size_t nasm_unquote_anystr(char *str, char **ep, const uint32_t badctl,
          * * any kind, including collapsing double quote marks.)
          * We obviously can't get here if qstart == '\"'.
          */
-        while ((c = *p++) && (c != bq))
-            EMIT(c);
+        if (!badctl) {
+            /* Nothing to check, so just move the contents down */
+            const char bqs[2] = { bq, '\0' };
+            size_t n = strcspn((const char *)p, bqs);
+
+            memmove(q, p, n);
+            q += n;
+            p += n + 1;
+        } else {
+            while ((c = *p++) && (c != bq))
+                EMIT(c);
+        }
     } else {
 	/* Not a quoted string, just return the input... */
         while ((c = *p++))
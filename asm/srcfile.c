@@ -49,18 +49,34 @@
 #include "hashtbl.h"
 #include "srcfile.h"
 
-struct src_location_stack _src_top;
-struct src_location_stack *_src_bottom = &_src_top;
-struct src_location_stack *_src_error = &_src_top;
+/*
+ * The location stack is per thread; the filename hash is not, and is
+ * only ever modified by the preprocessor.
+ */
+thread_local_var struct src_location_stack _src_top;
+thread_local_var struct src_location_stack *_src_bottom;
+thread_local_var struct src_location_stack *_src_error;
 
 static struct hash_table filename_hash;
 
+/*
+ * Set up an empty location stack for the calling thread. This must
+ * be done before any error can be issued.
+ */
 void src_init(void)
 {
+    nasm_zero(_src_top);
+    _src_bottom = _src_error = &_src_top;
 }
 
 void src_free(void)
 {
+    /* Unwind any macro levels left over from a fatal error */
+    while (_src_bottom != &_src_top)
+        src_macro_pop();
+    nasm_zero(_src_top);
+    _src_error = &_src_top;
+
     hash_free_all(&filename_hash, false);
 }
 
@@ -116,3 +132,48 @@ void src_macro_pop(void)
 
     nasm_free(sl);
 }
+
+void src_save_stack(struct src_saved_stack *ss)
+{
+    const struct src_location_stack *sl;
+    size_t n = 0;
+
+    for (sl = &_src_top; sl; sl = sl->down) {
+        if (n >= ss->size) {
+            ss->size = ss->size ? ss->size << 1 : 8;
+            ss->levels = nasm_realloc(ss->levels,
+                                      ss->size * sizeof *ss->levels);
+        }
+        ss->levels[n++] = *sl;
+    }
+    ss->nlevels = n;
+}
+
+void src_load_stack(struct src_saved_stack *ss)
+{
+    struct src_location_stack *sl, *up;
+    size_t n;
+
+    _src_top.l     = ss->levels[0].l;
+    _src_top.macro = ss->levels[0].macro;
+    _src_top.up    = NULL;
+
+    up = &_src_top;
+    for (n = 1; n < ss->nlevels; n++) {
+        sl = &ss->levels[n];
+        sl->up = up;
+        up->down = sl;
+        up = sl;
+    }
+    up->down = NULL;
+
+    _src_bottom = up;
+    _src_error  = &_src_top;
+}
+
+void src_free_saved_stack(struct src_saved_stack *ss)
+{
+    nasm_free(ss->levels);
+    ss->levels = NULL;
+    ss->nlevels = ss->size = 0;
+}
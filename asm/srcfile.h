@@ -66,9 +66,9 @@ struct src_location_stack {
     struct src_location_stack *up, *down;
     const void *macro;
 };
-extern struct src_location_stack _src_top;
-extern struct src_location_stack *_src_bottom;
-extern struct src_location_stack *_src_error;
+extern thread_local_var struct src_location_stack _src_top;
+extern thread_local_var struct src_location_stack *_src_bottom;
+extern thread_local_var struct src_location_stack *_src_error;
 
 void src_init(void);
 void src_free(void);
@@ -180,4 +180,19 @@ static inline const void *src_macro_current(void)
 }
 void src_macro_pop(void);
 
+/*
+ * A copy of the entire location stack. This is used to hand the
+ * location of a line from the preprocessor thread to the assembler
+ * thread in pipelined mode. A loaded stack is read-only: the
+ * levels point into the saved copy, which therefore has to remain
+ * untouched until another stack is loaded or src_init() is called.
+ */
+struct src_saved_stack {
+    struct src_location_stack *levels;
+    size_t nlevels, size;
+};
+void src_save_stack(struct src_saved_stack *ss);
+void src_load_stack(struct src_saved_stack *ss);
+void src_free_saved_stack(struct src_saved_stack *ss);
+
 #endif /* ASM_SRCFILE_H */
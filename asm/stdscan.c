@@ -80,7 +80,8 @@ void stdscan_reset(void)
 void stdscan_cleanup(void)
 {
     stdscan_reset();
-    nasm_free(stdscan_tempstorage);
+    nasm_delete(stdscan_tempstorage);
+    stdscan_tempsize = 0;
 }
 
 static char *stdscan_copy(const char *p, int len)
@@ -162,8 +163,7 @@ static int stdscan_token(struct tokenval *tv)
 
         r = stdscan_bufptr++;
         /* read the entire buffer to advance the buffer pointer but... */
-        while (nasm_isidchar(*stdscan_bufptr))
-            stdscan_bufptr++;
+        stdscan_bufptr = nasm_skip_idchars(stdscan_bufptr);
 
         /* ... copy only up to IDLEN_MAX-1 characters */
         tv->t_charptr = stdscan_copy(r, stdscan_bufptr - r < IDLEN_MAX ?
@@ -172,7 +172,8 @@ static int stdscan_token(struct tokenval *tv)
         if (is_sym || stdscan_bufptr - r > MAX_KEYWORD)
             return tv->t_type = TOKEN_ID;       /* bypass all other checks */
 
-        token_type = nasm_token_hash(tv->t_charptr, tv);
+        token_type = nasm_token_hash_len(tv->t_charptr,
+                                         stdscan_bufptr - r, tv);
         if (unlikely(tv->t_flag & TFLAG_WARN)) {
             /*! ptr [on] non-NASM keyword used in other assemblers
              *!  warns about keywords used in other assemblers that
@@ -257,9 +258,8 @@ static int stdscan_token(struct tokenval *tv)
             tv->t_charptr = stdscan_copy(r, stdscan_bufptr - r);
             return tv->t_type = TOKEN_FLOAT;
         } else {
-            r = stdscan_copy(r, stdscan_bufptr - r);
-            tv->t_integer = readnum(r, &rn_error);
-            stdscan_pop();
+            /* Convert in place, the scanner knows where the number ends */
+            tv->t_integer = readnum_len(r, stdscan_bufptr - r, &rn_error);
             if (rn_error) {
                 /* some malformation occurred */
                 return tv->t_type = TOKEN_ERRNUM;
@@ -307,7 +307,7 @@ static int stdscan_token(struct tokenval *tv)
         stdscan_bufptr++;       /* skip closing brace */
 
         /* handle tokens inside braces */
-        nasm_token_hash(tv->t_charptr, tv);
+        nasm_token_hash_len(tv->t_charptr, token_len, tv);
         return stdscan_handle_brace(tv);
     } else if (*stdscan_bufptr == ';') {
         /* a comment has happened - stay */
@@ -44,6 +44,7 @@ char *stdscan_get(void);
 void stdscan_reset(void);
 int stdscan(void *private_data, struct tokenval *tv);
 int nasm_token_hash(const char *token, struct tokenval *tv);
+int nasm_token_hash_len(const char *token, size_t len, struct tokenval *tv);
 void stdscan_cleanup(void);
 
 #endif
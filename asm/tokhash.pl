@@ -176,17 +176,18 @@ if ($output eq 'h') {
     # tokhash.c
     #
 
-    @hashinfo = gen_perfect_hash(\%tokens);
+    @hashinfo = gen_perfect_hash(\%tokens, \&prehash_words);
     if (!@hashinfo) {
 	die "$0: no hash found\n";
     }
 
     # Paranoia...
-    verify_hash_table(\%tokens, \@hashinfo);
+    verify_hash_table(\%tokens, \@hashinfo, \&prehash_words);
 
     ($n, $sv, $g) = @hashinfo;
     die if ($n & ($n-1));
-    $n <<= 1;
+
+    $max_words = ($max_len + 3) >> 2;
 
     print "/*\n";
     print " * This file is generated from insns.dat, regs.dat and token.dat\n";
@@ -196,7 +197,7 @@ if ($output eq 'h') {
 
     print "#include \"compiler.h\"\n";
     print "#include \"nasm.h\"\n";
-    print "#include \"hashtbl.h\"\n";
+    print "#include \"bytesex.h\"\n";
     print "#include \"insns.h\"\n";
     print "#include \"stdscan.h\"\n";
     print "\n";
@@ -214,7 +215,20 @@ if ($output eq 'h') {
     print "};\n";
     print "\n";
 
-    print "int nasm_token_hash(const char *token, struct tokenval *tv)\n";
+    # Downcase four ASCII characters at a time without branching:
+    # a byte gets bit 5 set iff it is in the range 'A'..'Z'.
+    print "static inline uint32_t tokhash_tolower(uint32_t w)\n";
+    print "{\n";
+    print "    uint32_t l = w & 0x7f7f7f7f;\n";
+    print "    uint32_t ge_a = l + 0x3f3f3f3f;        /* >= 'A' */\n";
+    print "    uint32_t gt_z = l + 0x25252525;        /* >  'Z' */\n";
+    print "\n";
+    print "    return w | (((ge_a & ~gt_z & ~w) & 0x80808080) >> 2);\n";
+    print "}\n";
+    print "\n";
+
+    print "int nasm_token_hash_len(const char *token, size_t len,\n";
+    print "                        struct tokenval *tv)\n";
     print "{\n";
 
     # Put a large value in unused slots.  This makes it extremely unlikely
@@ -222,8 +236,8 @@ if ($output eq 'h') {
     # This speeds up rejection of unrecognized tokens, i.e. identifiers.
     print "#define INVALID_HASH_ENTRY (65535/3)\n";
 
-    printf "    static const int16_t hashdata[%d] = {\n", $n;
-    for ($i = 0; $i < $n; $i++) {
+    printf "    static const int16_t hashdata[%d] = {\n", $n << 1;
+    for ($i = 0; $i < ($n << 1); $i++) {
 	my $h = ${$g}[$i];
 	print "        ", defined($h) ? $h : 'INVALID_HASH_ENTRY', ",\n";
     }
@@ -241,24 +255,27 @@ if ($output eq 'h') {
     # width as the hash arrays.
     print  "    uint16_t ix;\n";
     print  "    const struct tokendata *data;\n";
-    printf "    char lcbuf[%d];\n", $max_len+1;
-    print  "    const char *p = token;\n";
-    print  "    char c, *q = lcbuf;\n";
-    print  "    size_t len = 0;\n";
-    printf "    uint64_t crc = UINT64_C(0x%08x%08x);\n", $$sv[0], $$sv[1];
+    printf "    uint32_t lcbuf[%d], words[%d];\n", $max_words, $max_words;
+    print  "    size_t n, nwords;\n";
     print  "\n";
-    print  "    while ((c = *p++)) {\n";
-    printf "        if (++len > %d)\n", $max_len;
-    print  "            goto notfound;\n";
-    print  "        *q++ = c = nasm_tolower(c);\n";
-    print  "        crc = crc64_byte(crc, c);\n";
-    print  "    };\n";
+    printf "    if (len > %d)\n", $max_len;
+    print  "        goto notfound;\n";
+    print  "\n";
+    print  "    /* Zero-pad the key to a whole number of words */\n";
+    print  "    nwords = (len + 3) >> 2;\n";
+    print  "    if (nwords)\n";
+    print  "        lcbuf[nwords-1] = 0;\n";
+    print  "    memcpy(lcbuf, token, len);\n";
+    print  "    for (n = 0; n < nwords; n++) {\n";
+    print  "        lcbuf[n] = tokhash_tolower(lcbuf[n]);\n";
+    print  "        words[n] = cpu_to_le32(lcbuf[n]);\n";
+    print  "    }\n";
     print  "\n";
-    printf "    k1 = ((uint32_t)crc & 0x%x) + 0;\n", $n-2;
-    printf "    k2 = ((uint32_t)(crc >> 32) & 0x%x) + 1;\n", $n-2;
+    print  "    {\n";
+    print  prehash_words_c('        ', \@hashinfo);
+    print  "    }\n";
     print  "\n";
-    printf "    ix = hashdata[k1] + hashdata[k2];\n",
-	$n-2, $n-2;
+    print  "    ix = hashdata[k1] + hashdata[k2];\n";
     printf "    if (ix >= %d)\n", scalar(@tokendata);
     print  "        goto notfound;\n";
     print  "\n";
@@ -279,4 +296,11 @@ if ($output eq 'h') {
     print  "    tv->t_flag    = 0;\n";
     print  "    return tv->t_type = TOKEN_ID;\n";
     print  "}\n";
+    print  "\n";
+
+    print  "int nasm_token_hash(const char *token, struct tokenval *tv)\n";
+    print  "{\n";
+    printf "    return nasm_token_hash_len(token, strnlen(token, %d), tv);\n",
+	$max_len+1;
+    print  "}\n";
 }
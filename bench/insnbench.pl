@@ -0,0 +1,520 @@
+#!/usr/bin/perl
+## --------------------------------------------------------------------------
+##
+##   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+##   See the file AUTHORS included with the NASM distribution for
+##   the specific copyright holders.
+##
+##   Redistribution and use in source and binary forms, with or without
+##   modification, are permitted provided that the following
+##   conditions are met:
+##
+##   * Redistributions of source code must retain the above copyright
+##     notice, this list of conditions and the following disclaimer.
+##   * Redistributions in binary form must reproduce the above
+##     copyright notice, this list of conditions and the following
+##     disclaimer in the documentation and/or other materials provided
+##     with the distribution.
+##
+##     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+##     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+##     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+##     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+##     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+##     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+##     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+##     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+##     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+##     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+##     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+##     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+##     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+##
+## --------------------------------------------------------------------------
+
+#
+# insnbench.pl - encoder throughput benchmark
+#
+# Generates, from x86/insns.dat, one source file per instruction class
+# containing a large number of 64-bit instructions with varied
+# operand forms, assembles each with -f bin at -O0 and -Ox, and
+# reports the number of instructions assembled per second.  Since the
+# preprocessor and output costs are the same for every class, this
+# isolates the cost of the instruction matching and encoding.
+# "make insn-bench" runs this script.
+#
+# Usage: insnbench.pl [--nasm=path] [--insns=insns.dat] [--dir=dir]
+#                     [--count=n] [--repeat=n] [--keep] [class...]
+#
+# The classes are:
+#
+#    legacy   general purpose instructions
+#    branch   jumps, calls and loops to labels at varying distances
+#    x87      floating point unit
+#    sse      MMX and SSE (no VEX)
+#    vex      VEX encoded AVX, AVX2, FMA, BMI, ...
+#    evex     EVEX encoded AVX-512, with masking, zeroing, broadcast
+#             and embedded rounding/SAE
+#    amx      AMX tile instructions
+#
+# Operand forms are chosen from the instruction templates; templates
+# which can't be instantiated are skipped, and lines which NASM rejects
+# (for example because of an operand combination which is invalid in
+# 64-bit mode) are dropped before measuring.
+#
+# The output has the same format as nasmlib-bench: one result per
+# line, with the tab-separated fields
+#
+#    group    case    metric    value
+#
+# where the group is "insn" and the case is the class.  The metrics are
+# the number of instructions and distinct mnemonics in the file, the
+# number of generated lines which were dropped, and for each
+# optimization level the best time of all runs in seconds and the
+# number of instructions per second.  The time of assembling an empty
+# file with the same options is subtracted before computing the rate.
+#
+# If NASM was configured with --enable-trace-events, the time is also
+# broken down by pass type, from the "pass" spans of --trace-events:
+# metrics secs-O0-first, secs-Ox-optimize, secs-Ox-final and so on,
+# each the best of all runs.  This separates the matching and
+# encoding done in the final pass from the size computations of the
+# first and optimization passes, whose count depends on the -O level.
+#
+
+use strict;
+use warnings;
+
+use Getopt::Long qw(GetOptions);
+use File::Path qw(mkpath);
+use File::Spec;
+use Time::HiRes qw(time);
+
+my $nasm   = './nasm';
+my $insns  = 'x86/insns.dat';
+my $dir    = 'bench/insn';
+my $count  = 20000;
+my $repeat = 3;
+my $keep   = 0;
+
+GetOptions('nasm=s'   => \$nasm,
+           'insns=s'  => \$insns,
+           'dir=s'    => \$dir,
+           'count=i'  => \$count,
+           'repeat=i' => \$repeat,
+           'keep'     => \$keep)
+    or die "Usage: $0 [--nasm=path] [--insns=insns.dat] [--dir=dir] ".
+    "[--count=n] [--repeat=n] [--keep] [class...]\n";
+
+$count  = 100 if ($count < 100);
+$repeat = 1 if ($repeat < 1);
+
+my @classes = qw(legacy branch x87 sse vex evex amx);
+my @opts    = qw(O0 Ox);
+
+#
+# Concrete operands.  Each choice list is walked by a counter, so that
+# consecutive uses of a template get different registers and
+# addressing modes.
+#
+my @mem = ('[rbx]', '[rbp-16]', '[rsi+0x80]', '[rsp+rcx*4+8]',
+           '[r12+r13*2+0x12345]', '[rax+rdx]', '[r9-0x1000]');
+my %size = (8 => 'byte', 16 => 'word', 32 => 'dword', 64 => 'qword',
+            80 => 'tword', 128 => 'oword', 256 => 'yword', 512 => 'zword');
+
+my %reg = (
+    'reg8'    => [qw(al cl dl bl sil r9b r12b)],
+    'reg16'   => [qw(ax cx dx bx si r8w r13w)],
+    'reg32'   => [qw(eax ecx edx ebx esi r8d r11d)],
+    'reg32na' => [qw(ecx edx ebx esi r8d r11d)],
+    'reg64'   => [qw(rax rcx rdx rbx rsi r8 r14)],
+    'reg_sreg' => [qw(fs gs)],
+    'reg_creg' => [qw(cr0 cr3)],
+    'reg_dreg' => [qw(dr0 dr7)],
+    'mmxreg'  => [qw(mm0 mm1 mm2 mm3 mm4 mm5 mm6 mm7)],
+    'xmmreg'  => [qw(xmm0 xmm1 xmm5 xmm7 xmm8 xmm13 xmm15)],
+    'ymmreg'  => [qw(ymm0 ymm2 ymm6 ymm7 ymm9 ymm12 ymm15)],
+    'zmmreg'  => [qw(zmm0 zmm3 zmm7 zmm11 zmm16 zmm24 zmm31)],
+    'kreg'    => [qw(k1 k2 k3 k4 k5 k6 k7)],
+    'fpureg'  => [qw(st1 st2 st3 st4 st5 st6 st7)],
+    'tmmreg'  => [qw(tmm0 tmm1 tmm2 tmm3 tmm4 tmm5 tmm6 tmm7)],
+    'bndreg'  => [qw(bnd0 bnd1 bnd2 bnd3)],
+);
+
+my %vsib = (
+    'xmem' => [qw([rax+xmm1*4] [rbx+xmm6*8+16] [r10+xmm13*2])],
+    'ymem' => [qw([rax+ymm2*4] [rbx+ymm7*8+16] [r10+ymm14*2])],
+    'zmem' => [qw([rax+zmm3*4] [rbx+zmm8*8+16] [r10+zmm20*2])],
+);
+
+my %imm = (
+    'imm8'  => [qw(3 0x7f 0x40)],
+    'imm16' => [qw(3 0x1234 0x7fff)],
+    'imm32' => [qw(3 0x12345678 -100000)],
+    'imm64' => [qw(3 0x123456789abc -2)],
+    'imm'   => [qw(3 0x1234 0x12345 -7)],
+);
+
+sub pick($$) {
+    my($list, $n) = @_;
+    return $list->[$n % scalar(@$list)];
+}
+
+#
+# Make one operand.  $type is the operand type without decorations;
+# $deco is a hash of the decorations; $n varies the choice.  Returns
+# the operand text and any {er}/{sae} operand which must follow it, or
+# undef if the type is not supported.
+#
+sub make_operand($$$) {
+    my($type, $deco, $n) = @_;
+    my $op;
+    my $after;
+
+    $type =~ s/\*$//;
+
+    if ($type =~ /^reg_(al|ax|eax|rax|cl|cx|ecx|rcx|dx|edx|es|cs|ss|ds|fs|gs)$/) {
+        $op = $1;
+    } elsif ($type eq 'xmm0') {
+        $op = 'xmm0';
+    } elsif ($type eq 'fpu0') {
+        $op = 'st0';
+    } elsif ($type eq 'unity') {
+        $op = '1';
+    } elsif ($type =~ /^sbyte/) {
+        $op = pick([qw(-3 5 0x7f)], $n);
+    } elsif ($type =~ /^(?:udword|sdword)$/) {
+        $op = pick([qw(0x1234 0x7fffffff)], $n);
+    } elsif (defined($imm{$type})) {
+        $op = pick($imm{$type}, $n);
+    } elsif (defined($reg{$type})) {
+        $op = pick($reg{$type}, $n);
+    } elsif ($type =~ /^kreg(8|16|32|64)$/) {
+        $op = pick($reg{'kreg'}, $n);
+    } elsif ($type =~ /^([xyz]mem)(32|64)$/) {
+        $op = pick($vsib{$1}, $n);
+    } elsif ($type eq 'mem') {
+        $op = pick(\@mem, $n);
+    } elsif ($type =~ /^mem(\d+)$/) {
+        $op = $size{$1}.' '.pick(\@mem, $n);
+    } elsif ($type =~ /^(rm|krm|mmxrm|xmmrm|ymmrm|zmmrm)(\d*)$/) {
+        my($kind, $bits) = ($1, $2);
+        my $regtype = {'rm' => "reg$bits", 'krm' => 'kreg',
+                       'mmxrm' => 'mmxreg', 'xmmrm' => 'xmmreg',
+                       'ymmrm' => 'ymmreg', 'zmmrm' => 'zmmreg'}->{$kind};
+        my $memory = ($n & 1) && !$deco->{'er'} && !$deco->{'sae'};
+        if (!$memory) {
+            $op = pick($reg{$regtype}, $n >> 1);
+        } elsif (my($eb) = grep { /^b\d+$/ } keys(%$deco)) {
+            $eb =~ s/^b//;
+            my $vbits = $bits || 128;
+            if ($n & 2) {
+                $op = pick(\@mem, $n >> 2).'{1to'.($vbits/$eb).'}';
+            } else {
+                $op = pick(\@mem, $n >> 2);
+            }
+        } elsif ($bits && $size{$bits}) {
+            $op = $size{$bits}.' '.pick(\@mem, $n >> 1);
+        } else {
+            $op = pick(\@mem, $n >> 1);
+        }
+    } else {
+        return undef;
+    }
+
+    if ($deco->{'mask'} && ($n % 3)) {
+        $op .= '{k'.(1 + $n % 7).'}';
+        $op .= '{z}' if ($deco->{'z'} && ($n % 3) == 2);
+    }
+    if ($deco->{'er'}) {
+        $after = pick([qw({rn-sae} {rd-sae} {ru-sae} {rz-sae})], $n);
+    } elsif ($deco->{'sae'}) {
+        $after = '{sae}';
+    }
+
+    return ($op, $after);
+}
+
+my @conds = qw(z nz l ge b ae s ns o no p np le g be a);
+
+#
+# Read the instruction templates and sort them into classes.
+#
+my %templates = map { $_ => [] } @classes;
+
+open(my $in, '<', $insns) or die "$0: $insns: $!\n";
+while (defined(my $line = <$in>)) {
+    chomp $line;
+    next if ($line =~ /^\s*(;|$)/);
+    next unless ($line =~ /^\s*(\S+)\s+(\S+)\s+(\[.*?\]|\S+)\s+(\S+)\s*$/);
+    my($mnem, $ops, $code, $flags) = ($1, $2, $3, $4);
+
+    next if ($code eq 'ignore' || $code !~ /^\[/);
+    my %flags = map { $_ => 1 } split(/,/, $flags);
+    next if ($flags{'NOLONG'} || $flags{'ND'} || $flags{'OBSOLETE'});
+    next if ($mnem =~ /^(D[BWDQTOYZ]|RES[BWDQTOYZ]|INCBIN)$/);
+    next if ($ops =~ /\|(rs\d|far)\b/ || $ops =~ /:/);
+
+    my $class;
+    if ($mnem =~ /^(J|CALL$|LOOP)/) {
+        $class = 'branch';
+    } elsif (grep { /^AMX/ } keys(%flags)) {
+        $class = 'amx';
+    } elsif ($code =~ /\bevex\./) {
+        $class = 'evex';
+    } elsif ($code =~ /\bvex\./) {
+        $class = 'vex';
+    } elsif ($flags{'FPU'}) {
+        $class = 'x87';
+    } elsif ($ops =~ /(xmm|mmx)/) {
+        $class = 'sse';
+    } elsif ($code =~ /\b(xop|vex)/i || $ops =~ /[yz]mm|kreg|tmm/) {
+        next;
+    } else {
+        $class = 'legacy';
+    }
+
+    push(@{$templates{$class}}, [$mnem, $ops, $code]);
+}
+close($in);
+
+#
+# Make one line from a template, or undef if it can't be done.  For
+# branches, $labels is the number of labels and $line the number of
+# the label before this line.
+#
+sub make_line($$$$) {
+    my($t, $n, $labels, $line) = @_;
+    my($mnem, $ops, $code) = @$t;
+    my @out;
+
+    if ($mnem =~ /cc/) {
+        my $cc = pick(\@conds, $n);
+        $mnem =~ s/cc/$cc/;
+    }
+    $mnem = lc($mnem);
+
+    if ($ops ne 'void') {
+        my $k = 0;
+        foreach my $o (split(/,/, $ops)) {
+            my($type, @deco) = split(/\|/, $o);
+            my %deco = map { $_ => 1 } @deco;
+
+            if ($labels && $type =~ /^imm/) {
+                # Branch target: near and far, forward and backward
+                my $short = $deco{'short'} || $code =~ /\brel8\b/;
+                my $d = $short ? pick([1, -2, 3], $n)
+                    : pick([1, -2, 3, 40, -40, 200], $n);
+                push(@out, ($deco{'short'} ? 'short ' : '').
+                     sprintf('L%d', ($line + $d) % $labels));
+                next;
+            }
+
+            my($op, $after) = make_operand($type, \%deco, $n + 3*$k++);
+            return undef unless (defined($op));
+            $op = 'to '.$op if ($deco{'to'});
+            push(@out, $op);
+            push(@out, $after) if (defined($after));
+        }
+    }
+
+    return "\t$mnem".(@out ? ' '.join(', ', @out) : '')."\n";
+}
+
+#
+# Generate the corpus for one class: $count lines cycling through the
+# templates, with a label on every line for the branch class.  Returns
+# the lines, without the header.
+#
+sub gen_class($) {
+    my($class) = @_;
+    my $tl = $templates{$class};
+    my @lines;
+    my $n = 0;
+    my $fails = 0;
+
+    return () unless (@$tl);
+
+    while (scalar(@lines) < $count && $fails < scalar(@$tl)) {
+        my $t = $tl->[$n % scalar(@$tl)];
+        my $l = make_line($t, int($n / scalar(@$tl)) + $n,
+                          $class eq 'branch' ? $count : 0, scalar(@lines));
+        $n++;
+        if (!defined($l)) {
+            $fails++;
+            next;
+        }
+        $fails = 0;
+        push(@lines, $l);
+    }
+
+    if ($class eq 'branch') {
+        for (my $i = 0; $i < scalar(@lines); $i++) {
+            $lines[$i] = "L$i:\n".$lines[$i];
+        }
+        # Labels which are only referenced
+        for (my $i = scalar(@lines); $i < $count; $i++) {
+            push(@lines, "L$i:\n");
+        }
+    }
+
+    return @lines;
+}
+
+# Not the null device: NASM removes its output file after an error
+my $binfile = File::Spec->catfile($dir, 'out.bin');
+my $tracefile = File::Spec->catfile($dir, 'trace.json');
+my @passtypes = qw(first optimize stabilize final);
+my $header = "\tbits 64\n\tdefault rel\n";
+
+# Assemble $file with the given -O option; return the stderr output
+sub assemble($$) {
+    my($file, $opt) = @_;
+    return scalar(`"$nasm" -f bin -$opt -o "$binfile" "$file" 2>&1`);
+}
+
+# Best time of $repeat runs
+sub time_file($$) {
+    my($file, $opt) = @_;
+    my $best;
+
+    for (my $run = 0; $run < $repeat; $run++) {
+        my $start = time();
+        my $err = assemble($file, $opt);
+        my $secs = time() - $start;
+        die "$0: $file: nasm failed:\n$err" if ($?);
+        $best = $secs if (!defined($best) || $secs < $best);
+    }
+    return $best;
+}
+
+#
+# Best time of $repeat runs for each pass type, from the pass spans of
+# --trace-events, as a hash reference.  Returns undef if this NASM
+# does not support trace events.
+#
+sub time_passes($$) {
+    my($file, $opt) = @_;
+    my %best;
+
+    for (my $run = 0; $run < $repeat; $run++) {
+        my $err = `"$nasm" -f bin -$opt --trace-events="$tracefile" -o "$binfile" "$file" 2>&1`;
+        return undef if ($? && $err =~ /does not support `--trace-events'/);
+        die "$0: $file: nasm failed:\n$err" if ($?);
+
+        my %secs;
+        open(my $tin, '<', $tracefile) or die "$0: $tracefile: $!\n";
+        while (defined(my $l = <$tin>)) {
+            $secs{$1} += $2 / 1e6
+                if ($l =~ /"cat":"pass","name":"(\w+)".*"dur":([0-9.]+)/);
+        }
+        close($tin);
+
+        foreach my $t (keys %secs) {
+            $best{$t} = $secs{$t}
+                if (!defined($best{$t}) || $secs{$t} < $best{$t});
+        }
+    }
+    return \%best;
+}
+
+my %want = map { $_ => 1 } @ARGV;
+foreach my $w (keys %want) {
+    die "$0: unknown class: $w\n" unless (grep { $_ eq $w } @classes);
+}
+
+mkpath($dir);
+
+my $empty = File::Spec->catfile($dir, 'empty.asm');
+open(my $eout, '>', $empty) or die "$0: $empty: $!\n";
+print $eout $header;
+close($eout);
+my %base = map { $_ => time_file($empty, $_) } @opts;
+my $have_trace = defined(time_passes($empty, $opts[0]));
+
+print "# insnbench count=$count repeat=$repeat\n";
+print "# no per-pass times: NASM needs --enable-trace-events\n"
+    unless ($have_trace);
+print "# group\tcase\tmetric\tvalue\n";
+
+foreach my $class (@classes) {
+    next if (%want && !$want{$class});
+
+    my $file = File::Spec->catfile($dir, "$class.asm");
+    my @lines = gen_class($class);
+    next unless (@lines);
+    my $generated = grep { /^\t/m } @lines;
+
+    #
+    # Drop the lines NASM rejects, using the line numbers in the error
+    # messages.  Labels are kept even if the instruction after them is
+    # dropped, since other lines may branch to them.
+    #
+    for (my $try = 0; $try < 8; $try++) {
+        open(my $out, '>', $file) or die "$0: $file: $!\n";
+        print $out $header, @lines;
+        close($out);
+
+        my $err = assemble($file, 'O0');
+        last unless ($?);
+
+        my %bad;
+        my $hlines = () = $header =~ /\n/g;
+        foreach my $l (split(/\n/, $err)) {
+            $bad{$1 - $hlines} = 1
+                if ($l =~ /^\Q$file\E:(\d+): (?:error|fatal):/);
+        }
+        die "$0: $class: nasm failed:\n$err" unless (%bad);
+
+        # Map physical lines back to entries (branch entries have two)
+        my @keep;
+        my $ln = 1;
+        foreach my $l (@lines) {
+            my $nl = () = $l =~ /\n/g;
+            my $drop = 0;
+            for (my $i = 0; $i < $nl; $i++) {
+                $drop = 1 if ($bad{$ln + $i});
+            }
+            $ln += $nl;
+            if ($drop && $l =~ /^(L\d+:\n)/) {
+                push(@keep, $1);        # Keep the label
+            } elsif (!$drop) {
+                push(@keep, $l);
+            }
+        }
+        @lines = @keep;
+    }
+
+    my $ninsns = grep { /^\t/m } @lines;
+    my %tmpl;
+    foreach my $l (@lines) {
+        $tmpl{$1} = 1 if ($l =~ /^\t(\S+)/m);
+    }
+
+    printf "insn\t%s\tinsns\t%.3f\n", $class, $ninsns;
+    printf "insn\t%s\tmnemonics\t%.3f\n", $class, scalar(keys %tmpl);
+    printf "insn\t%s\tdropped\t%.3f\n", $class, $generated - $ninsns;
+    foreach my $opt (@opts) {
+        my $secs = time_file($file, $opt);
+        my $net = $secs - $base{$opt};
+        $net = 1e-6 if ($net <= 0);
+        printf "insn\t%s\tsecs-%s\t%.3f\n", $class, $opt, $secs;
+        printf "insn\t%s\tinsns/s-%s\t%.3f\n", $class, $opt, $ninsns / $net;
+
+        next unless ($have_trace);
+        my $passes = time_passes($file, $opt);
+        foreach my $t (@passtypes) {
+            printf "insn\t%s\tsecs-%s-%s\t%.3f\n", $class, $opt, $t,
+                $passes->{$t} if (defined($passes->{$t}));
+        }
+    }
+
+    unlink($file) unless ($keep);
+}
+
+unlink($binfile);
+unlink($tracefile);
+unless ($keep) {
+    unlink($empty);
+    rmdir($dir);
+}
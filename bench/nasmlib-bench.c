@@ -0,0 +1,712 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * nasmlib-bench.c - micro-benchmarks for the nasmlib containers
+ *
+ * Exercises the hash table, SAA, RAA, red-black tree, string list and
+ * hash functions in isolation, using a deterministic pseudo-random
+ * workload, so that a change to one of them can be evaluated without
+ * the noise of a full assembler run.  "make nasmlib-bench" builds and
+ * runs this program.
+ *
+ * Usage: nasmlib-bench [-n count] [-r repeat] [group...]
+ *
+ * The output is one result per line, with four tab-separated fields:
+ *
+ *    group    case    metric    value
+ *
+ * Lines starting with # are comments.  The set and order of the lines
+ * only depends on the arguments, and the metrics which are not times
+ * (probe lengths, load factors) are exactly reproducible.  Each timed
+ * case is run "repeat" times and the best result is reported.  Times
+ * are CPU times as measured by clock().
+ */
+
+#include "compiler.h"
+
+#include <ctype.h>              /* For toupper() */
+#include <time.h>
+
+#include "nasmlib.h"
+#include "hashtbl.h"
+#include "saa.h"
+#include "raa.h"
+#include "rbtree.h"
+#include "strlist.h"
+#include "md5.h"
+#include "perfhash.h"
+#include "directiv.h"
+#include "ver.h"
+
+static size_t count = 100000;   /* Number of elements per case */
+static unsigned int repeat = 3; /* Number of runs per timed case */
+
+static volatile uint64_t sink;  /* Keeps results from being optimized away */
+
+/*
+ * Deterministic pseudo-random numbers (xorshift64*); reseeded before
+ * every run so that all runs see the same workload.
+ */
+static uint64_t rng_state;
+
+static void rng_seed(uint64_t seed)
+{
+    rng_state = seed ? seed : 1;
+}
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * UINT64_C(2685821657736338717);
+}
+
+static size_t rng_below(size_t n)
+{
+    return (size_t)(rng() % n);
+}
+
+/*
+ * Result collection.  Results are printed in the order in which they
+ * are first recorded; for timed results the best of all runs is kept.
+ */
+enum better { BEST_NONE, BEST_LOW, BEST_HIGH };
+
+struct result {
+    const char *group, *name, *metric;
+    enum better better;
+    double value;
+};
+
+static struct result *results;
+static size_t nresults, maxresults;
+
+static void record(const char *group, const char *name, const char *metric,
+                   enum better better, double value)
+{
+    struct result *r;
+    size_t i;
+
+    for (i = 0; i < nresults; i++) {
+        r = &results[i];
+        if (!strcmp(r->group, group) && !strcmp(r->name, name) &&
+            !strcmp(r->metric, metric)) {
+            if ((better == BEST_LOW && value < r->value) ||
+                (better == BEST_HIGH && value > r->value) ||
+                better == BEST_NONE)
+                r->value = value;
+            return;
+        }
+    }
+
+    if (nresults >= maxresults) {
+        maxresults = maxresults ? maxresults << 1 : 64;
+        results = nasm_realloc(results, maxresults * sizeof *results);
+    }
+    r = &results[nresults++];
+    r->group  = group;
+    r->name   = name;
+    r->metric = metric;
+    r->better = better;
+    r->value  = value;
+}
+
+static void print_results(void)
+{
+    size_t i;
+
+    for (i = 0; i < nresults; i++) {
+        const struct result *r = &results[i];
+        printf("%s\t%s\t%s\t%.3f\n", r->group, r->name, r->metric, r->value);
+    }
+}
+
+/*
+ * Timing.  A case is bracketed by timer_start() and timer_stop(),
+ * which records the time per operation and, if bytes is nonzero, the
+ * throughput.
+ */
+static clock_t timer_started;
+
+static void timer_start(void)
+{
+    timer_started = clock();
+}
+
+static void timer_stop(const char *group, const char *name,
+                       size_t ops, size_t bytes)
+{
+    double secs = (double)(clock() - timer_started) / CLOCKS_PER_SEC;
+
+    if (secs <= 0.0)
+        secs = 1.0 / CLOCKS_PER_SEC; /* Below the resolution of clock() */
+
+    record(group, name, "ns/op", BEST_LOW, secs * 1e9 / ops);
+    if (bytes)
+        record(group, name, "MB/s", BEST_HIGH, bytes / secs / 1e6);
+}
+
+/*
+ * Symbol names with roughly the mix found in real sources: compound
+ * identifiers in various styles, local and macro-local labels,
+ * compiler-generated labels and the occasional long mangled name.
+ */
+static const char * const words[] = {
+    "read", "write", "buf", "len", "ptr", "init", "free", "loop",
+    "next", "done", "start", "end", "tmp", "count", "table", "entry",
+    "offset", "size", "data", "text", "msg", "str", "idx", "val",
+    "flag", "mask", "reg", "addr", "base", "limit", "err", "ret",
+    "check", "copy", "fill", "scan", "hash", "node", "list", "head"
+};
+
+static const char *word(void)
+{
+    return words[rng_below(ARRAY_SIZE(words))];
+}
+
+static char *gen_name(size_t i)
+{
+    char buf[128];
+    unsigned int r = rng_below(100);
+    const char *w1 = word(), *w2 = word();
+
+    if (r < 35) {
+        snprintf(buf, sizeof buf, "%s_%s", w1, w2);
+    } else if (r < 50) {
+        snprintf(buf, sizeof buf, "%c%s%c%s",
+                 toupper(w1[0]), w1+1, toupper(w2[0]), w2+1);
+    } else if (r < 65) {
+        snprintf(buf, sizeof buf, "%s_%u.%s", w1,
+                 (unsigned int)rng_below(count/8+1), w2);
+    } else if (r < 75) {
+        snprintf(buf, sizeof buf, "..@%u.%s",
+                 (unsigned int)rng_below(count), w1);
+    } else if (r < 85) {
+        snprintf(buf, sizeof buf, ".L%u", (unsigned int)i);
+    } else if (r < 93) {
+        snprintf(buf, sizeof buf, "%s%u", w1,
+                 (unsigned int)rng_below(1000));
+    } else {
+        snprintf(buf, sizeof buf, "_ZN%u%s%u%s17h%016"PRIx64"E",
+                 (unsigned int)strlen(w1), w1,
+                 (unsigned int)strlen(w2), w2, rng());
+    }
+
+    return nasm_strdup(buf);
+}
+
+static char **names;            /* Unique (even ignoring case) names */
+static char **inames;           /* The same names with random case */
+static char **missnames;        /* Names which are not in the set */
+static size_t *order;           /* Random permutation of 0..count-1 */
+
+static void make_names(void)
+{
+    struct hash_table dedup;
+    struct hash_insert hi;
+    size_t i, j;
+
+    memset(&dedup, 0, sizeof dedup);
+    rng_seed(1);
+
+    nasm_newn(names, count);
+    nasm_newn(inames, count);
+    nasm_newn(missnames, count);
+    nasm_newn(order, count);
+
+    for (i = 0; i < count; i++) {
+        char *name = gen_name(i);
+
+        if (hash_findi(&dedup, name, &hi)) {
+            char *uname = nasm_asprintf("%s_%u", name, (unsigned int)i);
+            nasm_free(name);
+            name = uname;
+            hash_findi(&dedup, name, &hi);
+        }
+        hash_add(&hi, name, name);
+        names[i] = name;
+
+        inames[i] = nasm_strdup(name);
+        for (j = 0; inames[i][j]; j++) {
+            if (rng() & 1)
+                inames[i][j] = toupper((unsigned char)inames[i][j]);
+        }
+
+        /* '?' is never the first character of a generated name */
+        missnames[i] = nasm_asprintf("?%s", name);
+    }
+    hash_free(&dedup);
+
+    for (i = 0; i < count; i++)
+        order[i] = i;
+    for (i = count-1; i > 0; i--) {
+        size_t k = rng_below(i+1);
+        size_t t = order[i];
+        order[i] = order[k];
+        order[k] = t;
+    }
+}
+
+/*
+ * Probe lengths.  This walks the same probe sequence as
+ * hash_findb()/hash_findib(), which must be kept in sync with
+ * hashtbl.c.  The length is the number of slots examined, including
+ * the matching one for a hit or the empty one for a miss.
+ */
+static size_t hash_probes(const struct hash_table *head,
+                          const char *key, bool icase, bool hit)
+{
+    size_t keylen = strlen(key)+1;
+    uint64_t hash = icase ? crc64ib(CRC64_INIT, key, keylen)
+        : crc64b(CRC64_INIT, key, keylen);
+    size_t mask = head->size - 1;
+    size_t pos = hash & mask;
+    size_t inc = ((hash >> 32) & mask) | 1;
+    size_t n = 1;
+
+    while (head->table[pos].key && (!hit || head->table[pos].key != key)) {
+        pos = (pos + inc) & mask;
+        n++;
+    }
+    return n;
+}
+
+static void bench_hash_one(const char *group, bool icase)
+{
+    void **(*find)(struct hash_table *, const char *, struct hash_insert *)
+        = icase ? hash_findi : hash_find;
+    char **lookup = icase ? inames : names;
+    struct hash_table head;
+    struct hash_insert hi;
+    size_t i, n, sum, max;
+    unsigned int run;
+
+    for (run = 0; run < repeat; run++) {
+        memset(&head, 0, sizeof head);
+
+        timer_start();
+        for (i = 0; i < count; i++) {
+            if (!find(&head, names[i], &hi))
+                hash_add(&hi, names[i], names[i]);
+        }
+        timer_stop(group, "insert", count, 0);
+
+        timer_start();
+        for (i = 0; i < count; i++) {
+            void **dp = find(&head, lookup[order[i]], NULL);
+            sink += (uintptr_t)*dp;
+        }
+        timer_stop(group, "lookup_hit", count, 0);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            sink += !find(&head, missnames[order[i]], NULL);
+        timer_stop(group, "lookup_miss", count, 0);
+
+        if (run == repeat-1) {
+            record(group, "table", "load", BEST_NONE,
+                   (double)head.load / head.size);
+
+            sum = max = 0;
+            for (i = 0; i < count; i++) {
+                n = hash_probes(&head, names[i], icase, true);
+                sum += n;
+                max = max > n ? max : n;
+            }
+            record(group, "probe_hit", "avg", BEST_NONE, (double)sum / count);
+            record(group, "probe_hit", "max", BEST_NONE, max);
+
+            sum = max = 0;
+            for (i = 0; i < count; i++) {
+                n = hash_probes(&head, missnames[i], icase, false);
+                sum += n;
+                max = max > n ? max : n;
+            }
+            record(group, "probe_miss", "avg", BEST_NONE, (double)sum / count);
+            record(group, "probe_miss", "max", BEST_NONE, max);
+        }
+
+        hash_free(&head);
+    }
+}
+
+static void bench_hash(void)
+{
+    bench_hash_one("hash_find", false);
+    bench_hash_one("hash_findi", true);
+}
+
+static void bench_saa(void)
+{
+    static const uint8_t src[64] = { 0x5a };
+    uint8_t dst[64];
+    size_t *len, *seqpos, *rndpos;
+    size_t i, total;
+    unsigned int run;
+    struct SAA *s;
+
+    /* Chunk sizes of 1 to 64 bytes, the range of instruction encodings */
+    rng_seed(2);
+    nasm_newn(len, count);
+    nasm_newn(seqpos, count);
+    nasm_newn(rndpos, count);
+    total = 0;
+    for (i = 0; i < count; i++) {
+        len[i] = 1 + rng_below(64);
+        seqpos[i] = total;
+        total += len[i];
+    }
+    for (i = 0; i < count; i++)
+        rndpos[i] = rng_below(total - 64);
+
+    for (run = 0; run < repeat; run++) {
+        s = saa_init(1);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            saa_wbytes(s, src, len[i]);
+        timer_stop("saa", "wbytes", count, total);
+
+        timer_start();
+        saa_rewind(s);
+        for (i = 0; i < count; i++) {
+            saa_rnbytes(s, dst, len[i]);
+            sink += dst[0];
+        }
+        timer_stop("saa", "rnbytes", count, total);
+
+        timer_start();
+        for (i = 0; i < count; i++) {
+            saa_fread(s, seqpos[i], dst, len[i]);
+            sink += dst[0];
+        }
+        timer_stop("saa", "fread_seq", count, total);
+
+        timer_start();
+        for (i = 0; i < count; i++) {
+            saa_fread(s, rndpos[i], dst, len[i]);
+            sink += dst[0];
+        }
+        timer_stop("saa", "fread_rand", count, total);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            saa_fwrite(s, seqpos[i], src, len[i]);
+        timer_stop("saa", "fwrite_seq", count, total);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            saa_fwrite(s, rndpos[i], src, len[i]);
+        timer_stop("saa", "fwrite_rand", count, total);
+
+        saa_free(s);
+    }
+
+    nasm_free(len);
+    nasm_free(seqpos);
+    nasm_free(rndpos);
+}
+
+/*
+ * The RAA allocates a full leaf for every touched region, so the
+ * sparse cases use fewer elements to keep the memory use reasonable.
+ */
+static void bench_raa_one(const char *name, size_t n, raaindex range)
+{
+    struct RAA *r;
+    raaindex *idx;
+    size_t i;
+    unsigned int run;
+    /* These are referenced by the result table, so they are never freed */
+    char *wname = nasm_asprintf("%s_write", name);
+    char *rname = nasm_asprintf("%s_read", name);
+    char *hname = nasm_asprintf("%s_read_hole", name);
+
+    rng_seed(3);
+    nasm_newn(idx, n);
+    for (i = 0; i < n; i++)
+        idx[i] = range ? rng() % range : i;
+
+    for (run = 0; run < repeat; run++) {
+        r = raa_init();
+
+        timer_start();
+        for (i = 0; i < n; i++)
+            r = raa_write(r, idx[i], i);
+        timer_stop("raa", wname, n, 0);
+
+        timer_start();
+        for (i = 0; i < n; i++)
+            sink += raa_read(r, idx[order[i] % n]);
+        timer_stop("raa", rname, n, 0);
+
+        if (range) {
+            timer_start();
+            for (i = 0; i < n; i++)
+                sink += raa_read(r, idx[order[i] % n] ^ 1);
+            timer_stop("raa", hname, n, 0);
+        }
+
+        raa_free(r);
+    }
+
+    nasm_free(idx);
+}
+
+static void bench_raa(void)
+{
+    bench_raa_one("dense", count, 0);
+    bench_raa_one("sparse", count/64 + 1, (raaindex)count << 6);
+    bench_raa_one("wide", count/256 + 1, UINT64_C(1) << 40);
+}
+
+static void bench_rbtree_one(const char *iname, const char *sname,
+                             const char *ename, bool sequential)
+{
+    struct rbtree *nodes, *root;
+    uint64_t *keys;
+    size_t i;
+    unsigned int run;
+
+    rng_seed(4);
+    nasm_newn(keys, count);
+    for (i = 0; i < count; i++)
+        keys[i] = sequential ? (uint64_t)i << 4 : rng();
+
+    nasm_newn(nodes, count);
+    for (run = 0; run < repeat; run++) {
+        memset(nodes, 0, count * sizeof *nodes);
+        root = NULL;
+
+        timer_start();
+        for (i = 0; i < count; i++) {
+            nodes[i].key = keys[i];
+            root = rb_insert(root, &nodes[i]);
+        }
+        timer_stop("rbtree", iname, count, 0);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            sink += (uintptr_t)rb_search(root, keys[order[i]] + 1);
+        timer_stop("rbtree", sname, count, 0);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            sink += (uintptr_t)rb_search_exact(root, keys[order[i]]);
+        timer_stop("rbtree", ename, count, 0);
+    }
+
+    nasm_free(nodes);
+    nasm_free(keys);
+}
+
+static void bench_rbtree(void)
+{
+    bench_rbtree_one("insert_rand", "search_rand", "search_exact_rand",
+                     false);
+    bench_rbtree_one("insert_seq", "search_seq", "search_exact_seq", true);
+}
+
+static void bench_strlist(void)
+{
+    struct strlist *list;
+    size_t i;
+    unsigned int run;
+
+    for (run = 0; run < repeat; run++) {
+        list = strlist_alloc(true);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            strlist_add(list, names[i]);
+        timer_stop("strlist", "add_new", count, 0);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            strlist_add(list, names[order[i]]);
+        timer_stop("strlist", "add_dup", count, 0);
+
+        timer_start();
+        for (i = 0; i < count; i++)
+            sink += (uintptr_t)strlist_find(list, missnames[order[i]]);
+        timer_stop("strlist", "find_miss", count, 0);
+
+        strlist_free(&list);
+    }
+}
+
+static void bench_hashfn(void)
+{
+    static const size_t lengths[] = { 4, 8, 16, 32, 64, 256, 4096 };
+    static const char * const lnames[] = {
+        "len4", "len8", "len16", "len32", "len64", "len256", "len4096"
+    };
+    uint8_t *data;
+    size_t i, l, len, n;
+    unsigned int run;
+    unsigned char digest[MD5_HASHBYTES];
+    MD5_CTX ctx;
+
+    rng_seed(5);
+    nasm_newn(data, 4096);
+    for (i = 0; i < 4096; i++)
+        data[i] = rng();
+
+    for (l = 0; l < ARRAY_SIZE(lengths); l++) {
+        len = lengths[l];
+        /* The same number of bytes for every length */
+        n = (count << 6) / len;
+        if (n < 1000)
+            n = 1000;
+
+        for (run = 0; run < repeat; run++) {
+            timer_start();
+            for (i = 0; i < n; i++)
+                sink += crc64b(CRC64_INIT, data, len);
+            timer_stop("crc64b", lnames[l], n, n*len);
+
+            timer_start();
+            for (i = 0; i < n; i++)
+                sink += crc64ib(CRC64_INIT, data, len);
+            timer_stop("crc64ib", lnames[l], n, n*len);
+
+            timer_start();
+            for (i = 0; i < n; i++)
+                sink += crc32b(0, data, len);
+            timer_stop("crc32b", lnames[l], n, n*len);
+
+            timer_start();
+            for (i = 0; i < n; i++) {
+                MD5Init(&ctx);
+                MD5Update(&ctx, data, len);
+                MD5Final(digest, &ctx);
+                sink += digest[0];
+            }
+            timer_stop("md5", lnames[l], n, n*len);
+        }
+    }
+    nasm_free(data);
+
+    /*
+     * Perfect hash lookups, half of which are directive names and
+     * the other half symbol names which miss.
+     */
+    for (run = 0; run < repeat; run++) {
+        timer_start();
+        for (i = 0; i < count; i++) {
+            const char *key = (i & 1) ? names[order[i]]
+                : directive_tbl[i % ARRAY_SIZE(directive_tbl)];
+            sink += directive_find(key);
+        }
+        timer_stop("perfhash", "directive", count, 0);
+    }
+}
+
+static const struct bench_group {
+    const char *name;
+    void (*func)(void);
+} groups[] = {
+    { "hash",    bench_hash },
+    { "saa",     bench_saa },
+    { "raa",     bench_raa },
+    { "rbtree",  bench_rbtree },
+    { "strlist", bench_strlist },
+    { "hashfn",  bench_hashfn }
+};
+
+static no_return usage(const char *progname)
+{
+    size_t i;
+
+    fprintf(stderr, "Usage: %s [-n count] [-r repeat] [group...]\n"
+            "Groups:", progname);
+    for (i = 0; i < ARRAY_SIZE(groups); i++)
+        fprintf(stderr, " %s", groups[i].name);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    bool *run;
+    bool any = false;
+    int i;
+    size_t g;
+
+    nasm_newn(run, ARRAY_SIZE(groups));
+
+    for (i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (!strcmp(arg, "-n") || !strcmp(arg, "-r")) {
+            unsigned long v;
+            char *ep;
+
+            if (++i >= argc)
+                usage(argv[0]);
+            v = strtoul(argv[i], &ep, 0);
+            if (*ep || !v)
+                usage(argv[0]);
+            if (arg[1] == 'n')
+                count = v < 1000 ? 1000 : v;
+            else
+                repeat = v;
+        } else {
+            for (g = 0; g < ARRAY_SIZE(groups); g++) {
+                if (!strcmp(arg, groups[g].name))
+                    break;
+            }
+            if (g >= ARRAY_SIZE(groups))
+                usage(argv[0]);
+            run[g] = any = true;
+        }
+    }
+
+    printf("# nasmlib-bench %s\n", nasm_version);
+    printf("# count=%lu repeat=%u\n",
+           (unsigned long)count, repeat);
+    printf("# group\tcase\tmetric\tvalue\n");
+
+    make_names();
+
+    for (g = 0; g < ARRAY_SIZE(groups); g++) {
+        if (!any || run[g])
+            groups[g].func();
+    }
+
+    print_results();
+    nasm_free(run);
+    return 0;
+}
@@ -0,0 +1,403 @@
+#!/usr/bin/perl
+## --------------------------------------------------------------------------
+##
+##   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+##   See the file AUTHORS included with the NASM distribution for
+##   the specific copyright holders.
+##
+##   Redistribution and use in source and binary forms, with or without
+##   modification, are permitted provided that the following
+##   conditions are met:
+##
+##   * Redistributions of source code must retain the above copyright
+##     notice, this list of conditions and the following disclaimer.
+##   * Redistributions in binary form must reproduce the above
+##     copyright notice, this list of conditions and the following
+##     disclaimer in the documentation and/or other materials provided
+##     with the distribution.
+##
+##     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+##     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+##     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+##     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+##     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+##     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+##     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+##     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+##     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+##     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+##     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+##     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+##     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+##
+## --------------------------------------------------------------------------
+
+#
+# ppbench.pl - preprocessor throughput benchmark
+#
+# Generates a corpus of source files, each stressing one part of the
+# preprocessor, runs "nasm -E --pp-stats" on each of them and reports
+# the throughput together with the counters printed by --pp-stats.
+# "make pp-bench" runs this script.
+#
+# Usage: ppbench.pl [--nasm=path] [--dir=corpus-dir] [--scale=n]
+#                   [--repeat=n] [--keep] [case...]
+#
+# The output has the same format as nasmlib-bench: one result per
+# line, with the tab-separated fields
+#
+#    group    case    metric    value
+#
+# where the group is always "pp".  The metrics are the best time of
+# all runs in seconds, lines/s and tokens/s (lines and tokens produced
+# by the preprocessor per second) and the --pp-stats counters, which
+# are exactly reproducible.  The time is that of the whole nasm
+# process, so the corpus is made large enough for the startup cost to
+# be small.
+#
+
+use strict;
+use warnings;
+
+use Getopt::Long qw(GetOptions);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Time::HiRes qw(time);
+
+my $nasm   = './nasm';
+my $dir    = 'bench/pp';
+my $scale  = 20000;
+my $repeat = 3;
+my $keep   = 0;
+
+GetOptions('nasm=s'   => \$nasm,
+           'dir=s'    => \$dir,
+           'scale=i'  => \$scale,
+           'repeat=i' => \$repeat,
+           'keep'     => \$keep)
+    or die "Usage: $0 [--nasm=path] [--dir=dir] [--scale=n] [--repeat=n] [--keep] [case...]\n";
+
+$scale  = 100 if ($scale < 100);
+$repeat = 1 if ($repeat < 1);
+
+#
+# Corpus generators.  Each one returns the text of a source file with
+# roughly $n lines of work.
+#
+
+# Deep chains of single-line macros with parameters
+sub gen_smacro_chain($) {
+    my($n) = @_;
+    my $depth = 40;
+    my $s = "%define c0(x) (x)\n";
+    for (my $i = 1; $i <= $depth; $i++) {
+        $s .= sprintf("%%define c%d(x) c%d(x+%d)\n", $i, $i-1, $i);
+    }
+    for (my $i = 0; $i < $n; $i++) {
+        $s .= sprintf("\tdd c%d(%d), c%d(%d)\n",
+                      $depth, $i, $depth >> 1, $i);
+    }
+    return $s;
+}
+
+# A chain of aliases defined with %define, expanded on every use
+sub gen_define_lazy($) {
+    my($n) = @_;
+    my $depth = 30;
+    my $s = "%define v0 value\n";
+    for (my $i = 1; $i <= $depth; $i++) {
+        $s .= sprintf("%%define v%d v%d\n", $i, $i-1);
+    }
+    for (my $i = 0; $i < $n; $i++) {
+        $s .= "\tmov eax, v$depth + $i\n";
+    }
+    return $s;
+}
+
+# The same chain with %xdefine, expanded once at definition time
+sub gen_xdefine($) {
+    my($n) = @_;
+    my $depth = 30;
+    my $s = "%xdefine v0 value\n";
+    for (my $i = 1; $i <= $depth; $i++) {
+        $s .= sprintf("%%xdefine v%d v%d\n", $i, $i-1);
+    }
+    for (my $i = 0; $i < $n; $i++) {
+        $s .= "\tmov eax, v$depth + $i\n";
+    }
+    return $s;
+}
+
+# Variadic multi-line macros walking their arguments with %rotate
+sub gen_varargs_rotate($) {
+    my($n) = @_;
+    my $s = <<'EOF';
+%macro pushall 1-*
+%rep %0
+	push %1
+%rotate 1
+%endrep
+%endmacro
+%macro popall 1-*
+%rep %0
+%rotate -1
+	pop %1
+%endrep
+%endmacro
+EOF
+    for (my $i = 0; $i < $n; $i += 16) {
+        $s .= "\tpushall rax, rbx, rcx, rdx, rsi, rdi, r8, r9\n";
+        $s .= "\tpopall rax, rbx, rcx, rdx, rsi, rdi, r8, r9\n";
+    }
+    return $s;
+}
+
+# Instruction wrappers with many overloads of the same name
+sub gen_overloads($) {
+    my($n) = @_;
+    my $over = 32;
+    my $s = '';
+    for (my $i = $over-1; $i >= 0; $i--) {
+        $s .= "%macro vop $i\n\tdb $i\n%endmacro\n";
+    }
+    for (my $i = 0; $i < $n; $i++) {
+        $s .= "\tvop " . join(', ', (1..($i % $over))) . "\n";
+    }
+    return $s;
+}
+
+# %rep loops with %assign counters and conditionals
+sub gen_rep_assign($) {
+    my($n) = @_;
+    my $outer = int($n / 100) + 1;
+    return <<"EOF";
+%assign i 0
+%rep $outer
+%assign j 0
+%rep 50
+%assign k i*50+j
+%if k % 3
+	dd k, k*2+1
+%else
+	dw k & 0xffff
+%endif
+%assign j j+1
+%endrep
+%assign i i+1
+%endrep
+EOF
+}
+
+# Structured-programming macros built on the context stack
+sub gen_context($) {
+    my($n) = @_;
+    my $s = <<'EOF';
+%macro IF 1
+%push if
+	j%-1 %$ifnot
+%endmacro
+%macro ELSE 0
+%ifctx if
+%repl else
+	jmp %$ifend
+%$ifnot:
+%else
+%error "expected IF before ELSE"
+%endif
+%endmacro
+%macro ENDIF 0
+%ifctx if
+%$ifnot:
+%pop
+%elifctx else
+%$ifend:
+%pop
+%else
+%error "expected IF or ELSE before ENDIF"
+%endif
+%endmacro
+EOF
+    for (my $i = 0; $i < $n; $i += 10) {
+        $s .= <<'EOF';
+	cmp eax, ebx
+IF z
+	cmp ecx, edx
+	IF nz
+		inc eax
+	ELSE
+		dec eax
+	ENDIF
+ELSE
+	xor eax, eax
+ENDIF
+EOF
+    }
+    return $s;
+}
+
+# String processing with %strcat, %substr and %strlen
+sub gen_strings($) {
+    my($n) = @_;
+    my $count = int($n / 8) + 1;
+    return <<"EOF";
+%assign i 0
+%rep $count
+%defstr num i
+%strcat name 'label_', num, '_', num, '_end'
+%strlen len name
+%substr head name 1,6
+%substr tail name len-3,4
+%strcat both head, tail
+	db name, len, both
+%assign i i+1
+%endrep
+EOF
+}
+
+# One string built up piece by piece with %strcat, so that every step
+# unquotes and quotes an ever longer string.  Each step still copies
+# the whole string, so the total time is quadratic in the chain length.
+sub gen_strcat_long($) {
+    my($n) = @_;
+    my $count = int($n / 4) + 1;
+    return <<"EOF";
+%define str ''
+%rep $count
+%strcat str str, 'abcdefghij'
+%endrep
+%strlen len str
+%substr tail str len-9,10
+	db tail
+	dd len
+EOF
+}
+
+# Explicit and implicit token pasting
+sub gen_paste($) {
+    my($n) = @_;
+    my $count = int($n / 4) + 1;
+    return <<"EOF";
+%define cat(a,b) a %+ b
+%define pfx sym
+%macro entry 2
+%1_%2:
+	dd cat(%1,%2), cat(pfx, %2)
+%endmacro
+%assign i 0
+%rep $count
+lbl_%[i]_x:
+	dd pfx%+_tail_%[i]
+	entry item, %[i]
+%assign i i+1
+%endrep
+EOF
+}
+
+# Large blocks of configuration-dependent code, mostly disabled
+sub gen_false_branch($) {
+    my($n) = @_;
+    my @os = qw(LINUX WIN64 MACOS FREEBSD);
+    my $s = "%define OS_LINUX\n";
+    for (my $i = 0; $i < $n; $i += 50) {
+        foreach my $os (@os) {
+            $s .= "%ifdef OS_$os\n";
+            $s .= "%if $i % 3\n" if ($os eq 'WIN64');
+            for (my $j = 0; $j < 10; $j++) {
+                $s .= "\tmov rax, [rbx + ${j}*8 + $i]\t; $os path\n";
+                $s .= "\tdb 'cfg_${os}_$j', 0\n";
+            }
+            $s .= "%endif\n" if ($os eq 'WIN64');
+            $s .= "%endif\n";
+        }
+    }
+    return $s;
+}
+
+# The standard macro packages
+sub gen_use($) {
+    my($n) = @_;
+    my $count = int($n / 6) + 1;
+    return <<"EOF";
+%use altreg
+%use smartalign
+%use ifunc
+%use fp
+	bits 64
+%assign i 1
+%rep $count
+	mov r0d, r1d
+	mov r8l, r9l
+	dd float32(1.5), ilog2(i)
+	align 16
+%assign i i+1
+%endrep
+EOF
+}
+
+my @cases = (
+    [ 'smacro_chain',   \&gen_smacro_chain ],
+    [ 'define_lazy',    \&gen_define_lazy ],
+    [ 'xdefine',        \&gen_xdefine ],
+    [ 'varargs_rotate', \&gen_varargs_rotate ],
+    [ 'overloads',      \&gen_overloads ],
+    [ 'rep_assign',     \&gen_rep_assign ],
+    [ 'context',        \&gen_context ],
+    [ 'strings',        \&gen_strings ],
+    [ 'strcat_long',    \&gen_strcat_long ],
+    [ 'paste',          \&gen_paste ],
+    [ 'false_branch',   \&gen_false_branch ],
+    [ 'use',            \&gen_use ]
+);
+
+my %want = map { $_ => 1 } @ARGV;
+foreach my $w (keys %want) {
+    die "$0: unknown case: $w\n" unless (grep { $_->[0] eq $w } @cases);
+}
+
+my @stats = qw(lines_read lines_skipped lines_out tokens_out smacro_calls mmacro_calls
+               pastes evals_fast evals_full tok_alloc tok_free tok_peak tok_blocks);
+
+mkpath($dir);
+
+# Not the null device: NASM removes its output file after an error
+my $outfile = File::Spec->catfile($dir, 'out.i');
+
+print "# ppbench scale=$scale repeat=$repeat\n";
+print "# group\tcase\tmetric\tvalue\n";
+
+foreach my $c (@cases) {
+    my($name, $gen) = @$c;
+    next if (%want && !$want{$name});
+
+    my $file = File::Spec->catfile($dir, "$name.asm");
+    open(my $out, '>', $file) or die "$0: $file: $!\n";
+    print $out $gen->($scale);
+    close($out);
+
+    my $best;
+    my %st;
+    for (my $run = 0; $run < $repeat; $run++) {
+        my $start = time();
+        my $err = `"$nasm" -E -o "$outfile" --pp-stats "$file" 2>&1`;
+        my $secs = time() - $start;
+        die "$0: $name: nasm failed:\n$err" if ($?);
+
+        foreach my $l (split(/\n/, $err)) {
+            $st{$1} = $2 if ($l =~ /^pp-stats:\s+(\S+)\s+(\d+)$/);
+        }
+        $best = $secs if (!defined($best) || $secs < $best);
+    }
+    $best = 1e-6 if ($best <= 0);
+
+    printf "pp\t%s\tsecs\t%.3f\n", $name, $best;
+    printf "pp\t%s\tlines/s\t%.3f\n", $name, ($st{'lines_out'} // 0) / $best;
+    printf "pp\t%s\ttokens/s\t%.3f\n", $name, ($st{'tokens_out'} // 0) / $best;
+    foreach my $s (@stats) {
+        printf "pp\t%s\t%s\t%.3f\n", $name, $s, $st{$s} // 0;
+    }
+
+    unlink($file) unless ($keep);
+}
+
+unlink($outfile);
+rmdir($dir) unless ($keep);
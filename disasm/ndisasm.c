@@ -97,7 +97,6 @@ int main(int argc, char **argv)
     int64_t offset;
     FILE *fp;
 
-    nasm_ctype_init();
     iflag_clear_all(&prefer);
 
     offset = 0;
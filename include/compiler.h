@@ -290,6 +290,21 @@ static inline void *mempset(void *dst, int c, size_t n)
 # define inline_prototypes
 #endif
 
+/*
+ * Threads are only used for the optional pipelined assembly mode;
+ * this requires POSIX threads as well as C11 atomics and thread-local
+ * storage. Without them, thread_local_var is simply a static
+ * variable and everything runs in a single thread.
+ */
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && \
+    defined(HAVE_STDATOMIC_H) && !defined(__STDC_NO_ATOMICS__) && \
+    defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+# define HAVE_THREADS 1
+# define thread_local_var _Thread_local
+#else
+# define thread_local_var
+#endif
+
 /*
  * Hints to the compiler that a particular branch of code is more or
  * less likely to be taken.
@@ -106,8 +106,8 @@ static inline int32_t debug_macro_seg(const struct debug_macro_addr *dma)
     return dma->tree.key;
 }
 
-/* Get/create a addr structure for the macro we are emitting for */
-struct debug_macro_addr *debug_macro_get_addr(int32_t seg);
+/* Record output to [start,end) in seg by the macro we are emitting for */
+void debug_macro_add_range(int32_t seg, uint64_t start, uint64_t end);
 
 /* The macro we are currently emitting for, if any */
 extern struct debug_macro_inv *debug_current_macro;
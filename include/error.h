@@ -143,6 +143,21 @@ typedef struct nasm_errhold *errhold;
 errhold nasm_error_hold_push(void);
 void nasm_error_hold_pop(errhold hold, bool issue);
 
+/*
+ * True if anything was raised while the hold was active, including
+ * warnings that were suppressed.
+ */
+bool nasm_error_hold_seen(errhold hold);
+
+/*
+ * Deferred errors: in pipelined mode, errors issued on the
+ * preprocessor thread are collected, and handed over to the assembler
+ * thread together with the line they belong to.
+ */
+struct nasm_errtext;
+struct nasm_errtext *nasm_error_take_deferred(void);
+void nasm_error_issue_deferred(struct nasm_errtext *list);
+
 /* Should be included from within error.h only */
 #include "warnings.h"
 
@@ -59,7 +59,19 @@ enum label_type {
     LBL_BACKEND                 /* Backend-defined symbols like ..got */
 };
 
+/*
+ * A label handle stays valid until cleanup_labels(); its serial
+ * number changes whenever the value of the label does.
+ */
+union label;
+typedef const union label *label_handle;
+
 enum label_type lookup_label(const char *label, int32_t *segment, int64_t *offset);
+enum label_type lookup_label_handle(const char *label, int32_t *segment,
+                                    int64_t *offset, label_handle *handle);
+uint64_t label_serial(label_handle handle);
+const char *label_name(label_handle handle);
+uint64_t label_serial_now(void);
 static inline bool is_extern(enum label_type type)
 {
     return type == LBL_EXTERN || type == LBL_REQUIRED;
@@ -72,8 +84,12 @@ bool declare_label(const char *label, enum label_type type,
 void set_label_mangle(enum mangle_index which, const char *what);
 int init_labels(void);
 void cleanup_labels(void);
+typedef void (*label_func)(const char *label, enum label_type type,
+                           int32_t segment, int64_t offset, void *data);
+void label_for_each(label_func func, void *data);
 const char *local_scope(const char *label);
 
 extern uint64_t global_offset_changed;
+extern bool first_pass_fwref;
 
 #endif /* LABELS_H */
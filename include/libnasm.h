@@ -0,0 +1,93 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * libnasm.h	interface for using the assembler as a library
+ *
+ * nasm_assemble_buffer() assembles a source buffer held in memory
+ * and returns the output file image, the symbols defined and the
+ * diagnostics in memory as well; no files are read or written
+ * unless the source or the options ask for it (e.g. %include, -l).
+ *
+ * The options are those of the command line, as a null-terminated
+ * array, without the input and output file names; e.g.
+ * { "-f", "elf64", "-Ox", NULL }.  The input file is named
+ * "<buffer>" in diagnostics.
+ *
+ * The assembler keeps global state, so these functions are not
+ * reentrant; calls must be serialized, but the library may be
+ * called any number of times in the same process.
+ */
+
+#ifndef NASM_LIBNASM_H
+#define NASM_LIBNASM_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Symbol flags */
+#define NASM_SYM_GLOBAL		0x01	/* GLOBAL or COMMON */
+#define NASM_SYM_EXTERN		0x02	/* EXTERN or REQUIRED */
+#define NASM_SYM_COMMON		0x04	/* COMMON */
+
+struct nasm_symbol {
+    char *name;
+    int32_t segment;            /* Internal segment number, -1 if absolute */
+    unsigned int flags;
+    int64_t offset;
+};
+
+struct nasm_result {
+    int status;                 /* 0 on success, like the exit status */
+    unsigned char *output;      /* Output file image */
+    size_t output_len;
+    char *diagnostics;          /* Error and warning text, null-terminated */
+    size_t diagnostics_len;
+    struct nasm_symbol *symbols;
+    size_t nsymbols;
+};
+
+int nasm_assemble_buffer(const char *source, size_t len,
+                         const char * const *options,
+                         struct nasm_result *result);
+void nasm_free_result(struct nasm_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NASM_LIBNASM_H */
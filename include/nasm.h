@@ -57,6 +57,9 @@
 /* Program name for error messages etc. */
 extern const char *_progname;
 
+/* The body of the assembler program; see asm/main.c */
+int nasm_main(int argc, char **argv);
+
 /* Time stamp for the official start of compilation */
 struct compile_time {
     time_t t;
@@ -423,7 +426,8 @@ enum preproc_mode {
 enum preproc_opt {
     PP_TRIVIAL  = 1,            /* Only %line or # directives */
     PP_NOLINE   = 2,            /* Ignore %line and # directives */
-    PP_TASM     = 4             /* TASM compatibility hacks */
+    PP_TASM     = 4,            /* TASM compatibility hacks */
+    PP_STATS    = 8             /* Collect statistics (--pp-stats) */
 };
 
 /*
@@ -456,6 +460,9 @@ void pp_cleanup_pass(void);
  */
 void pp_cleanup_session(void);
 
+/* Print the preprocessor statistics for this session (--pp-stats) */
+void pp_print_stats(FILE *f);
+
 /* Additional macros specific to output format */
 void pp_extra_stdmac(macros_t *macros);
 
@@ -979,6 +986,18 @@ struct ofmt {
      */
     int32_t (*section)(char *name, int *bits);
 
+    /*
+     * This procedure, if non-NULL, is called instead of section()
+     * when a section specifier (name and attributes) is repeated
+     * verbatim within the same pass. `seg' is the segment number
+     * section() returned for that specifier the first time it was
+     * seen in this pass; the return value and the handling of
+     * `*bits' are the same as for section().
+     *
+     * If NULL, section() is called for every section directive.
+     */
+    int32_t (*section_switch)(int32_t seg, int *bits);
+
     /*
      * This function is called when a label is defined
      * in the source code. It is allowed to change the section
@@ -1462,4 +1481,9 @@ extern const char *outname;     /* output filename */
  */
 int64_t switch_segment(int32_t segment);
 
+/*
+ * Pad the current location with NOPs up to a multiple of align
+ */
+void process_padding(uint64_t align);
+
 #endif  /* NASM_NASM_H */
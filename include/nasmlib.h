@@ -87,6 +87,30 @@ char * safe_alloc vprintf_func(1) nasm_vasprintf(const char *fmt, va_list ap);
 void * safe_alloc printf_func(2, 3) nasm_axprintf(size_t extra, const char *fmt, ...);
 void * safe_alloc vprintf_func(2) nasm_vaxprintf(size_t extra, const char *fmt, va_list ap);
 
+/*
+ * With --enable-alloc-stats, record the caller of each allocation
+ * function; see nasmlib/allocstats.c. The files implementing these
+ * functions define NASM_ALLOC_INTERNAL, so that allocations made on
+ * behalf of a caller are attributed to that caller.
+ */
+#if defined(ALLOC_STATS) && !defined(NASM_ALLOC_INTERNAL)
+extern thread_local_var const char *_nasm_alloc_file;
+extern thread_local_var int _nasm_alloc_line;
+# define NASM_ALLOC_SITE (_nasm_alloc_file = __FILE__, _nasm_alloc_line = __LINE__)
+# define nasm_malloc(s)          (NASM_ALLOC_SITE, nasm_malloc(s))
+# define nasm_zalloc(s)          (NASM_ALLOC_SITE, nasm_zalloc(s))
+# define nasm_calloc(n,s)        (NASM_ALLOC_SITE, nasm_calloc(n,s))
+# define nasm_realloc(p,s)       (NASM_ALLOC_SITE, nasm_realloc(p,s))
+# define nasm_strdup(s)          (NASM_ALLOC_SITE, nasm_strdup(s))
+# define nasm_strndup(s,n)       (NASM_ALLOC_SITE, nasm_strndup(s,n))
+# define nasm_strcat(a,b)        (NASM_ALLOC_SITE, nasm_strcat(a,b))
+# define nasm_strcatn(...)       (NASM_ALLOC_SITE, nasm_strcatn(__VA_ARGS__))
+# define nasm_asprintf(...)      (NASM_ALLOC_SITE, nasm_asprintf(__VA_ARGS__))
+# define nasm_vasprintf(f,a)     (NASM_ALLOC_SITE, nasm_vasprintf(f,a))
+# define nasm_axprintf(...)      (NASM_ALLOC_SITE, nasm_axprintf(__VA_ARGS__))
+# define nasm_vaxprintf(x,f,a)   (NASM_ALLOC_SITE, nasm_vaxprintf(x,f,a))
+#endif
+
 /*
  * nasm_last_string_len() returns the length of the last string allocated
  * by [v]asprintf, nasm_strdup, nasm_strcat, or nasm_strcatn.
@@ -96,12 +120,12 @@ void * safe_alloc vprintf_func(2) nasm_vaxprintf(size_t extra, const char *fmt,
  */
 static inline size_t nasm_last_string_len(void)
 {
-    extern size_t _nasm_last_string_size;
+    extern thread_local_var size_t _nasm_last_string_size;
     return _nasm_last_string_size - 1;
 }
 static inline size_t nasm_last_string_size(void)
 {
-    extern size_t _nasm_last_string_size;
+    extern thread_local_var size_t _nasm_last_string_size;
     return _nasm_last_string_size;
 }
 
@@ -237,6 +261,12 @@ static inline unsigned int numvalue(unsigned char c)
  */
 int64_t readnum(const char *str, bool *error);
 
+/*
+ * Same as readnum(), but reads at most `len' characters of `str', so
+ * the literal does not need to be null-terminated.
+ */
+int64_t readnum_len(const char *str, size_t len, bool *error);
+
 /*
  * Get the numeric base corresponding to a character
  */
@@ -280,6 +310,7 @@ int numstr(char *buf, size_t buflen, uint64_t n,
  * seg_alloc: allocate a hitherto unused segment number.
  */
 int32_t seg_alloc(void);
+void seg_alloc_reset(void);
 
 /*
  * Add/replace or remove an extension to the end of a filename
@@ -394,13 +425,31 @@ enum file_flags {
     NF_FORMAP   = 0x00000004,   /* Intended to use nasm_map_file() */
     NF_IONBF    = 0x00000010,   /* Force unbuffered stdio */
     NF_IOLBF    = 0x00000020,   /* Force line buffered stdio */
-    NF_IOFBF    = 0000000030    /* Force fully buffered stdio */
+    NF_IOFBF    = 0x00000030,   /* Force fully buffered stdio */
+    NF_ASYNC    = 0x00000040    /* Write from a background thread if possible */
 };
 #define NF_BUF_MASK  0x30
 
 FILE *nasm_open_read(const char *filename, enum file_flags flags);
 FILE *nasm_open_write(const char *filename, enum file_flags flags);
 
+/*
+ * In-memory files.  nasm_set_memfile() makes nasm_open_read() of the
+ * given filename return a stream over the buffer instead of a file on
+ * disk (NULL removes it; the buffer must stay valid until then).
+ * nasm_membuf_open() opens a write stream into memory;
+ * nasm_membuf_close() closes it and returns the contents in a
+ * null-terminated buffer allocated with malloc().
+ */
+void nasm_set_memfile(const char *filename, const void *buf, size_t len);
+struct nasm_membuf {
+    FILE *f;
+    char *buf;
+    size_t len;
+};
+FILE *nasm_membuf_open(struct nasm_membuf *mb);
+char *nasm_membuf_close(struct nasm_membuf *mb, size_t *lenp);
+
 void nasm_set_binary_mode(FILE *f);
 
 /* Probe for existence of a file */
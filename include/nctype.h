@@ -39,9 +39,7 @@
 
 #include "compiler.h"
 
-void nasm_ctype_init(void);
-
-extern unsigned char nasm_tolower_tab[256];
+extern const unsigned char nasm_tolower_tab[256];
 static inline char nasm_tolower(char x)
 {
     return nasm_tolower_tab[(unsigned char)x];
@@ -66,7 +64,7 @@ enum nasm_ctype {
     NCT_QUOTE      = 0x1000     /* " ' ` */
 };
 
-extern uint16_t nasm_ctype_tab[256];
+extern const uint16_t nasm_ctype_tab[256];
 static inline bool nasm_ctype(unsigned char x, enum nasm_ctype mask)
 {
     return (nasm_ctype_tab[x] & mask) != 0;
@@ -119,6 +117,31 @@ static inline bool nasm_isquote(char x)
     return nasm_ctype(x, NCT_QUOTE);
 }
 
+/*
+ * Skip a run of characters which all belong to at least one of the
+ * classes in `mask'.  This is still one table lookup per character;
+ * the inner loop only gives the compiler a fixed trip count to unroll.
+ * The mask must not include NCT_CTRL or NCT_ASCII, so that the NUL
+ * terminator always ends the run.
+ */
+static inline char *nasm_skip_ctype(const char *p, enum nasm_ctype mask)
+{
+    for (;;) {
+        int i;
+
+        for (i = 0; i < 16; i++) {
+            if (!nasm_ctype(p[i], mask))
+                return (char *)p + i;
+        }
+        p += 16;
+    }
+}
+
+static inline char *nasm_skip_idchars(const char *p)
+{
+    return nasm_skip_ctype(p, NCT_ID);
+}
+
 static inline void nasm_ctype_tasm_mode(void)
 {
     /* No differences at the present moment */
@@ -0,0 +1,99 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * trace.h - trace events for external profilers
+ *
+ * In a build configured with --enable-trace-events, the option
+ * --trace-events=file writes a trace of the assembly in the Chrome
+ * trace event format, which can be loaded into chrome://tracing,
+ * Perfetto and similar viewers. Otherwise all the macros below
+ * compile to nothing; they may still reference their time variable,
+ * so that it does not need to be conditional.
+ *
+ * TRACE_BEGIN(t)/TRACE_END(t,...) bracket a span whose start time is
+ * kept in the trace_time_t variable t. The span is only written out
+ * when it ends, which allows TRACE_END_MIN() to drop spans shorter
+ * than the threshold set by --trace-threshold, and lets a span end on
+ * another thread than the one it started on, as the include files do
+ * in pipelined mode.
+ */
+
+#ifndef NASM_TRACE_H
+#define NASM_TRACE_H
+
+#include "compiler.h"
+
+typedef uint64_t trace_time_t;  /* Nanoseconds */
+
+/*
+ * Start writing a trace to the named file, with TRACE_END_MIN()
+ * dropping spans shorter than threshold. Returns false if this
+ * build does not support trace events.
+ */
+bool trace_open(const char *filename, trace_time_t threshold);
+void trace_close(void);
+
+#ifdef TRACE_EVENTS
+
+extern bool trace_active;
+extern trace_time_t trace_threshold;
+
+void trace_thread_name(const char *name);
+trace_time_t trace_clock(void);
+void trace_span(const char *cat, const char *name, trace_time_t start,
+                trace_time_t min, const char *arg, int64_t argval);
+
+# define TRACE_BEGIN(t) ((t) = trace_active ? trace_clock() : 0)
+# define TRACE_END(t, cat, name)                                        \
+    (trace_active ? trace_span(cat, name, t, 0, NULL, 0) : (void)0)
+# define TRACE_END_ARG(t, cat, name, arg, val)                          \
+    (trace_active ? trace_span(cat, name, t, 0, arg, val) : (void)0)
+# define TRACE_END_MIN(t, cat, name, arg, val)                          \
+    (trace_active ? trace_span(cat, name, t, trace_threshold, arg, val) \
+     : (void)0)
+# define TRACE_THREAD(name)                                             \
+    (trace_active ? trace_thread_name(name) : (void)0)
+
+#else
+
+# define TRACE_BEGIN(t)                         ((void)((t) = 0))
+# define TRACE_END(t, cat, name)                ((void)(t))
+# define TRACE_END_ARG(t, cat, name, arg, val)  ((void)(t))
+# define TRACE_END_MIN(t, cat, name, arg, val)  ((void)(t))
+# define TRACE_THREAD(name)                     ((void)0)
+
+#endif /* TRACE_EVENTS */
+
+#endif /* NASM_TRACE_H */
@@ -35,12 +35,14 @@
  * nasmlib.c	library routines for the Netwide Assembler
  */
 
+#define NASM_ALLOC_INTERNAL 1
+
 #include "compiler.h"
 #include "nasmlib.h"
 #include "error.h"
 #include "alloc.h"
 
-size_t _nasm_last_string_size;
+thread_local_var size_t _nasm_last_string_size;
 
 fatal_func nasm_alloc_failed(void)
 {
@@ -61,6 +63,7 @@ again:
         }
         nasm_alloc_failed();
     }
+    nasm_alloc_stats_new(p, size);
     return p;
 }
 
@@ -78,6 +81,7 @@ again:
         }
         nasm_alloc_failed();
     }
+    nasm_alloc_stats_new(p, nelem * size);
 
     return p;
 }
@@ -96,16 +100,21 @@ void *nasm_zalloc(size_t size)
  */
 void *nasm_realloc(void *q, size_t size)
 {
+    void *p;
+
     if (unlikely(!size))
         size = 1;
-    q = q ? realloc(q, size) : malloc(size);
-    return validate_ptr(q);
+    p = validate_ptr(q ? realloc(q, size) : malloc(size));
+    nasm_alloc_stats_realloc(q, p, size);
+    return p;
 }
 
 void nasm_free(void *q)
 {
-    if (q)
+    if (q) {
+        nasm_alloc_stats_free(q);
         free(q);
+    }
 }
 
 char *nasm_strdup(const char *s)
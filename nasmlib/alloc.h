@@ -45,6 +45,16 @@ static inline void *validate_ptr(void *p)
     return p;
 }
 
-extern size_t _nasm_last_string_size;
+extern thread_local_var size_t _nasm_last_string_size;
+
+#ifdef ALLOC_STATS
+void nasm_alloc_stats_new(void *p, size_t size);
+void nasm_alloc_stats_realloc(void *oldp, void *p, size_t size);
+void nasm_alloc_stats_free(void *p);
+#else
+# define nasm_alloc_stats_new(p, size)          ((void)0)
+# define nasm_alloc_stats_realloc(oldp, p, size) ((void)0)
+# define nasm_alloc_stats_free(p)               ((void)0)
+#endif
 
 #endif /* NASMLIB_ALLOC_H */
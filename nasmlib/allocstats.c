@@ -0,0 +1,474 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * allocstats.c - allocation accounting for --enable-alloc-stats builds
+ *
+ * In such builds, the allocation functions are wrapped in macros (see
+ * nasmlib.h) which record the source location of the caller before
+ * calling the real function; here, every block is entered into a
+ * table keyed by its address, and the counts are accumulated per
+ * allocation site.  If the NASM_ALLOC_STATS environment variable is
+ * set, a report is written at exit to the file it names, or to stderr
+ * if it is empty or "-":
+ *
+ * - per source file (which is also the subsystem: preproc.c, saa.c,
+ *   labels.c, ...), and
+ * - per allocation site, the ones with the most bytes allocated first,
+ *
+ * with the number of allocations, the bytes requested, the peak of
+ * the live bytes and a histogram of lifetimes. Lifetimes are counted
+ * in allocations made in between, which unlike time is reproducible.
+ *
+ * All memory used here comes straight from malloc(), so it does not
+ * show up in the statistics.
+ */
+
+#define NASM_ALLOC_INTERNAL 1
+
+#include "compiler.h"
+#include "nasmlib.h"
+#include "ilog2.h"
+#include "alloc.h"
+
+#ifdef ALLOC_STATS
+
+#ifdef HAVE_THREADS
+# include <pthread.h>
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+# define stats_lock()   pthread_mutex_lock(&stats_lock)
+# define stats_unlock() pthread_mutex_unlock(&stats_lock)
+#else
+# define stats_lock()   ((void)0)
+# define stats_unlock() ((void)0)
+#endif
+
+thread_local_var const char *_nasm_alloc_file;
+thread_local_var int _nasm_alloc_line;
+
+/*
+ * Lifetime buckets: each covers a factor of 16 in the number of
+ * allocations made while the block was live.
+ */
+#define LIFE_BUCKETS    6
+static const char * const life_names[LIFE_BUCKETS] = {
+    "<16", "<256", "<4K", "<64K", "<1M", "more"
+};
+
+#define SHOW_SITES      40      /* Sites shown in the report */
+
+struct alloc_site {
+    const char *file;
+    int line;
+    uint64_t allocs;            /* Number of allocations */
+    uint64_t bytes;             /* Bytes requested, including growth */
+    uint64_t frees;
+    size_t live, peak;          /* Live bytes, and the peak thereof */
+    uint64_t life[LIFE_BUCKETS];
+};
+
+struct alloc_rec {
+    void *ptr;                  /* NULL if the slot is free */
+    size_t size;
+    uint64_t birth;             /* Value of alloc_clock when allocated */
+    uint32_t site;              /* Index into sites[] */
+};
+
+static enum { STATS_UNINIT, STATS_OFF, STATS_ON } stats_state;
+static const char *stats_file;
+static uint64_t alloc_clock;    /* Allocations so far */
+static size_t total_live, total_peak;
+
+static struct alloc_site *sites;
+static uint32_t nsites, sites_max;
+static uint32_t *site_hash;     /* Index + 1 into sites[], 0 = free */
+static uint32_t site_hash_size;
+
+static struct alloc_rec *recs;
+static size_t nrecs, recs_size;
+
+static void stats_report(void);
+
+static void *raw_alloc(size_t size)
+{
+    void *p = calloc(1, size);
+    if (!p)
+        nasm_alloc_failed();
+    return p;
+}
+
+static bool stats_init(void)
+{
+    if (likely(stats_state != STATS_UNINIT))
+        return stats_state == STATS_ON;
+
+    stats_file = getenv("NASM_ALLOC_STATS");
+    stats_state = stats_file ? STATS_ON : STATS_OFF;
+    if (stats_file)
+        atexit(stats_report);
+
+    return stats_state == STATS_ON;
+}
+
+static inline size_t hash_ptr(const void *p, size_t mask)
+{
+    uint64_t v = (uintptr_t)p;
+    return (size_t)((v * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & mask;
+}
+
+static uint32_t find_site(const char *file, int line)
+{
+    uint32_t mask, i, n;
+
+    if (nsites >= site_hash_size >> 1) {
+        /* Grow and rehash */
+        uint32_t *old = site_hash;
+        uint32_t oldsize = site_hash_size;
+
+        site_hash_size = oldsize ? oldsize << 1 : 1024;
+        site_hash = raw_alloc(site_hash_size * sizeof *site_hash);
+        mask = site_hash_size - 1;
+        for (i = 0; i < oldsize; i++) {
+            uint32_t j;
+            if (!old[i])
+                continue;
+            n = old[i] - 1;
+            j = (hash_ptr(sites[n].file, mask) + sites[n].line) & mask;
+            while (site_hash[j])
+                j = (j + 1) & mask;
+            site_hash[j] = old[i];
+        }
+        free(old);
+    }
+
+    mask = site_hash_size - 1;
+    i = (hash_ptr(file, mask) + line) & mask;
+    while (site_hash[i]) {
+        n = site_hash[i] - 1;
+        if (sites[n].file == file && sites[n].line == line)
+            return n;
+        i = (i + 1) & mask;
+    }
+
+    if (nsites >= sites_max) {
+        struct alloc_site *ns;
+        sites_max = sites_max ? sites_max << 1 : 512;
+        ns = realloc(sites, sites_max * sizeof *sites);
+        if (!ns)
+            nasm_alloc_failed();
+        sites = ns;
+    }
+    n = nsites++;
+    memset(&sites[n], 0, sizeof sites[n]);
+    sites[n].file = file;
+    sites[n].line = line;
+    site_hash[i] = n + 1;
+    return n;
+}
+
+static struct alloc_rec *find_rec(const void *p)
+{
+    size_t mask, i;
+
+    if (!recs_size)
+        return NULL;
+
+    mask = recs_size - 1;
+    for (i = hash_ptr(p, mask); recs[i].ptr; i = (i + 1) & mask) {
+        if (recs[i].ptr == p)
+            return &recs[i];
+    }
+    return NULL;
+}
+
+static void insert_rec(const struct alloc_rec *r)
+{
+    size_t mask, i;
+
+    if (nrecs >= recs_size >> 1) {
+        struct alloc_rec *old = recs;
+        size_t oldsize = recs_size;
+
+        recs_size = oldsize ? oldsize << 1 : 4096;
+        recs = raw_alloc(recs_size * sizeof *recs);
+        nrecs = 0;
+        for (i = 0; i < oldsize; i++) {
+            if (old[i].ptr)
+                insert_rec(&old[i]);
+        }
+        free(old);
+    }
+
+    mask = recs_size - 1;
+    for (i = hash_ptr(r->ptr, mask); recs[i].ptr; i = (i + 1) & mask)
+        ;
+    recs[i] = *r;
+    nrecs++;
+}
+
+/* Remove a record, closing the gap in the probe sequence */
+static void remove_rec(struct alloc_rec *r)
+{
+    size_t mask = recs_size - 1;
+    size_t i = r - recs;
+    size_t j = i;
+
+    while (true) {
+        size_t k;
+
+        j = (j + 1) & mask;
+        if (!recs[j].ptr)
+            break;
+        k = hash_ptr(recs[j].ptr, mask);
+        /* Move recs[j] to i unless its home slot lies in (i, j] */
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        recs[i] = recs[j];
+        i = j;
+    }
+    recs[i].ptr = NULL;
+    nrecs--;
+}
+
+static void site_grow(struct alloc_site *s, size_t oldsize, size_t newsize)
+{
+    s->live += newsize - oldsize;
+    if (s->live > s->peak)
+        s->peak = s->live;
+    total_live += newsize - oldsize;
+    if (total_live > total_peak)
+        total_peak = total_live;
+}
+
+static void forget(struct alloc_rec *r)
+{
+    struct alloc_site *s = &sites[r->site];
+    uint64_t age = alloc_clock - r->birth;
+    unsigned int bucket = age ? ilog2_64(age) >> 2 : 0;
+
+    if (bucket >= LIFE_BUCKETS)
+        bucket = LIFE_BUCKETS - 1;
+    s->life[bucket]++;
+    s->frees++;
+    s->live -= r->size;
+    total_live -= r->size;
+    remove_rec(r);
+}
+
+void nasm_alloc_stats_new(void *p, size_t size)
+{
+    struct alloc_rec r, *old;
+    struct alloc_site *s;
+
+    if (!stats_init())
+        return;
+
+    stats_lock();
+
+    /* A block freed behind our back, and its address reused */
+    old = find_rec(p);
+    if (old)
+        forget(old);
+
+    r.ptr   = p;
+    r.size  = size;
+    r.birth = alloc_clock++;
+    r.site  = find_site(_nasm_alloc_file ? _nasm_alloc_file : "(unknown)",
+                        _nasm_alloc_file ? _nasm_alloc_line : 0);
+    insert_rec(&r);
+
+    s = &sites[r.site];
+    s->allocs++;
+    s->bytes += size;
+    site_grow(s, 0, size);
+
+    stats_unlock();
+}
+
+void nasm_alloc_stats_realloc(void *oldp, void *p, size_t size)
+{
+    struct alloc_rec *r, copy;
+    struct alloc_site *s;
+
+    if (!oldp) {
+        nasm_alloc_stats_new(p, size);
+        return;
+    }
+
+    if (!stats_init())
+        return;
+
+    stats_lock();
+    r = find_rec(oldp);
+    if (r) {
+        /* The block keeps its original site and birth */
+        copy = *r;
+        remove_rec(r);
+        s = &sites[copy.site];
+        if (size > copy.size)
+            s->bytes += size - copy.size;
+        site_grow(s, copy.size, size);
+        copy.ptr  = p;
+        copy.size = size;
+        insert_rec(&copy);
+    }
+    stats_unlock();
+
+    if (!r)
+        nasm_alloc_stats_new(p, size);
+}
+
+void nasm_alloc_stats_free(void *p)
+{
+    struct alloc_rec *r;
+
+    if (!stats_init())
+        return;
+
+    stats_lock();
+    r = find_rec(p);
+    if (r)
+        forget(r);
+    stats_unlock();
+}
+
+static int cmp_sites(const void *a, const void *b)
+{
+    const struct alloc_site *sa = a, *sb = b;
+
+    if (sa->bytes != sb->bytes)
+        return sa->bytes < sb->bytes ? 1 : -1;
+    if (sa->allocs != sb->allocs)
+        return sa->allocs < sb->allocs ? 1 : -1;
+    return 0;
+}
+
+static void print_site(FILE *f, const char *name, const struct alloc_site *s)
+{
+    uint64_t total = s->allocs;
+    int i;
+
+    fprintf(f, "%-32s %10"PRIu64" %12"PRIu64" %12"PRIu64,
+            name, s->allocs, s->bytes, (uint64_t)s->peak);
+    for (i = 0; i < LIFE_BUCKETS; i++)
+        fprintf(f, " %4u%%",
+                (unsigned int)(total ? s->life[i] * 100 / total : 0));
+    fprintf(f, " %4u%%\n", (unsigned int)
+            (total ? (s->allocs - s->frees) * 100 / total : 0));
+}
+
+static void print_header(FILE *f, const char *what)
+{
+    int i;
+
+    fprintf(f, "\n%-32s %10s %12s %12s", what, "allocs", "bytes", "peak live");
+    for (i = 0; i < LIFE_BUCKETS; i++)
+        fprintf(f, " %5s", life_names[i]);
+    fprintf(f, " %5s\n", "live");
+}
+
+static void stats_report(void)
+{
+    struct alloc_site *byfile;
+    uint32_t nfiles, i, j;
+    FILE *f;
+    char buf[64];
+
+    stats_lock();
+
+    if (!stats_file[0] || !strcmp(stats_file, "-"))
+        f = stderr;
+    else
+        f = fopen(stats_file, "w");
+    if (!f)
+        goto done;
+
+    /*
+     * Sum up per file. The peak per file is the sum of the peaks
+     * of its sites, which is an upper bound.
+     */
+    byfile = raw_alloc((nsites + 1) * sizeof *byfile);
+    nfiles = 0;
+    for (i = 0; i < nsites; i++) {
+        const struct alloc_site *s = &sites[i];
+        struct alloc_site *t;
+        int k;
+
+        for (j = 0; j < nfiles; j++) {
+            if (!strcmp(byfile[j].file, s->file))
+                break;
+        }
+        t = &byfile[j];
+        if (j == nfiles) {
+            nfiles++;
+            t->file = s->file;
+        }
+        t->allocs += s->allocs;
+        t->bytes  += s->bytes;
+        t->frees  += s->frees;
+        t->peak   += s->peak;
+        for (k = 0; k < LIFE_BUCKETS; k++)
+            t->life[k] += s->life[k];
+    }
+
+    fprintf(f, "NASM allocation statistics: %"PRIu64" allocations, "
+            "peak %"PRIu64" bytes live, %"PRIu64" bytes live at exit\n",
+            alloc_clock, (uint64_t)total_peak, (uint64_t)total_live);
+    fprintf(f, "Lifetimes are counted in allocations made in between.\n");
+
+    qsort(byfile, nfiles, sizeof *byfile, cmp_sites);
+    print_header(f, "file");
+    for (i = 0; i < nfiles; i++)
+        print_site(f, byfile[i].file, &byfile[i]);
+
+    qsort(sites, nsites, sizeof *sites, cmp_sites);
+    print_header(f, "site");
+    for (i = 0; i < nsites && i < SHOW_SITES; i++) {
+        snprintf(buf, sizeof buf, "%s:%d", sites[i].file, sites[i].line);
+        print_site(f, buf, &sites[i]);
+    }
+
+    free(byfile);
+    if (f != stderr)
+        fclose(f);
+    else
+        fflush(f);
+
+    /* The site table is no longer indexed correctly */
+    stats_state = STATS_OFF;
+
+done:
+    stats_unlock();
+}
+
+#endif /* ALLOC_STATS */
@@ -31,6 +31,8 @@
  *
  * ----------------------------------------------------------------------- */
 
+#define NASM_ALLOC_INTERNAL 1
+
 #include "compiler.h"
 #include "nasmlib.h"
 #include "alloc.h"
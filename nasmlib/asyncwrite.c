@@ -0,0 +1,314 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * asyncwrite.c - write an output file from a background thread
+ *
+ * The output formats write their files with plain stdio calls, most
+ * of it at the very end, interleaved with building the symbol and
+ * relocation tables.  With NF_ASYNC, nasm_open_write() hands back a
+ * stdio stream of our own instead of the real file: whenever its
+ * buffer fills up, the contents are copied into an immutable block
+ * and queued for a writer thread, which does the actual I/O while
+ * the assembler goes on with the rest of its work.
+ *
+ * The thread is only started when the first block is queued: as soon
+ * as a process has a second thread, malloc() and stdio have to take
+ * locks, which slows down the assembly passes by much more than
+ * writing in the background saves. The output formats write their
+ * files at the end, so normally this only affects the final cleanup.
+ *
+ * Write errors are sticky: once the writer thread has failed, every
+ * further write to the stream fails, and so does fclose(), so the
+ * callers detect them the same way as with a plain file.
+ */
+
+#include "file.h"
+
+#if defined(HAVE_THREADS) && \
+    (defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN))
+
+#include <pthread.h>
+
+#define ASYNC_BUF_SIZE   (64 << 10) /* Buffer size of the front end stream */
+#define ASYNC_MAX_QUEUED (16 << 20) /* Queued bytes before the caller waits */
+
+struct async_block {
+    struct async_block *next;
+    size_t len;
+    char data[1];
+};
+
+struct async_file {
+    struct async_file *next;    /* List of open files */
+    FILE *front;                /* The stream given to the caller */
+    FILE *back;                 /* The real file */
+    pthread_t thread;
+    bool started;               /* The writer thread is running */
+    bool sync;                  /* It could not be started; write directly */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        /* Signalled on any change of state */
+    struct async_block *head, **tail;
+    size_t queued;              /* Bytes in the queue or being written */
+    bool closing;
+    int err;                    /* errno of the first failure, if any */
+};
+
+static struct async_file *async_files;
+
+static void *async_writer(void *arg)
+{
+    struct async_file *af = arg;
+    struct async_block *b;
+    int err;
+
+    pthread_mutex_lock(&af->lock);
+    while (true) {
+        while (!af->head && !af->closing)
+            pthread_cond_wait(&af->cond, &af->lock);
+
+        b = af->head;
+        if (!b)
+            break;              /* Closing, and nothing left to write */
+
+        af->head = b->next;
+        if (!af->head)
+            af->tail = &af->head;
+        err = af->err;
+        pthread_mutex_unlock(&af->lock);
+
+        if (!err && fwrite(b->data, 1, b->len, af->back) != b->len)
+            err = errno ? errno : EIO;
+
+        pthread_mutex_lock(&af->lock);
+        if (!af->err)
+            af->err = err;
+        af->queued -= b->len;
+        pthread_cond_broadcast(&af->cond);
+        nasm_free(b);
+    }
+    pthread_mutex_unlock(&af->lock);
+
+    return NULL;
+}
+
+/*
+ * Queue a copy of a buffer; returns false with errno set if the file
+ * is already in error.
+ */
+static bool async_queue(struct async_file *af, const char *buf, size_t size)
+{
+    struct async_block *b;
+    int err;
+
+    if (!af->started) {
+        af->started = true;
+        af->sync = !!pthread_create(&af->thread, NULL, async_writer, af);
+    }
+
+    if (af->sync) {
+        if (!af->err && fwrite(buf, 1, size, af->back) != size)
+            af->err = errno ? errno : EIO;
+        err = af->err;
+        if (err)
+            goto fail;
+        return true;
+    }
+
+    pthread_mutex_lock(&af->lock);
+    err = af->err;
+    pthread_mutex_unlock(&af->lock);
+    if (err)
+        goto fail;
+
+    b = nasm_malloc(sizeof(*b) + size);
+    b->next = NULL;
+    b->len  = size;
+    memcpy(b->data, buf, size);
+
+    pthread_mutex_lock(&af->lock);
+    while (af->queued >= ASYNC_MAX_QUEUED && !af->err)
+        pthread_cond_wait(&af->cond, &af->lock);
+    err = af->err;
+    if (!err) {
+        *af->tail = b;
+        af->tail = &b->next;
+        af->queued += size;
+        pthread_cond_broadcast(&af->cond);
+    }
+    pthread_mutex_unlock(&af->lock);
+
+    if (!err)
+        return true;
+
+    nasm_free(b);
+fail:
+    errno = err;
+    return false;
+}
+
+/* Wait until everything queued so far has been written */
+static void async_drain(struct async_file *af)
+{
+    pthread_mutex_lock(&af->lock);
+    while (af->queued)
+        pthread_cond_wait(&af->cond, &af->lock);
+    pthread_mutex_unlock(&af->lock);
+}
+
+/* Stop the writer thread, once it has written everything queued */
+static void async_stop(struct async_file *af)
+{
+    if (af->started && !af->sync) {
+        pthread_mutex_lock(&af->lock);
+        af->closing = true;
+        pthread_cond_broadcast(&af->cond);
+        pthread_mutex_unlock(&af->lock);
+
+        pthread_join(af->thread, NULL);
+    }
+    pthread_cond_destroy(&af->cond);
+    pthread_mutex_destroy(&af->lock);
+}
+
+static int async_close(void *cookie)
+{
+    struct async_file *af = cookie;
+    struct async_file **afp;
+    int err;
+
+    async_stop(af);
+
+    err = af->err;
+    if (fclose(af->back) && !err)
+        err = errno ? errno : EIO;
+
+    for (afp = &async_files; *afp; afp = &(*afp)->next) {
+        if (*afp == af) {
+            *afp = af->next;
+            break;
+        }
+    }
+    nasm_free(af);
+
+    if (err) {
+        errno = err;
+        return EOF;
+    }
+    return 0;
+}
+
+#ifdef HAVE_FOPENCOOKIE
+static ssize_t async_write(void *cookie, const char *buf, size_t size)
+{
+    /* fopencookie() wants 0, not -1, on error */
+    return async_queue(cookie, buf, size) ? (ssize_t)size : 0;
+}
+#else
+static int async_write(void *cookie, const char *buf, int size)
+{
+    return async_queue(cookie, buf, size) ? size : -1;
+}
+#endif
+
+/*
+ * exit() flushes, but does not close, the open streams; make sure
+ * the data actually reaches the files, e.g. after a fatal error with
+ * a listing file open.
+ */
+static void async_exit(void)
+{
+    struct async_file *af;
+
+    for (af = async_files; af; af = af->next) {
+        fflush(af->front);
+        async_drain(af);
+        fflush(af->back);
+    }
+}
+
+/*
+ * Wrap an open output file; if that is not possible, the file is
+ * returned as is.
+ */
+FILE *nasm_async_file(FILE *back)
+{
+    static bool atexit_done;
+    struct async_file *af;
+    FILE *f;
+
+    nasm_new(af);
+    af->back = back;
+    af->tail = &af->head;
+    pthread_mutex_init(&af->lock, NULL);
+    pthread_cond_init(&af->cond, NULL);
+
+#ifdef HAVE_FOPENCOOKIE
+    {
+        cookie_io_functions_t io;
+        nasm_zero(io);
+        io.write = async_write;
+        io.close = async_close;
+        f = fopencookie(af, "w", io);
+    }
+#else
+    f = funopen(af, NULL, async_write, NULL, async_close);
+#endif
+    if (!f) {
+        async_stop(af);
+        nasm_free(af);
+        return back;
+    }
+
+    setvbuf(f, NULL, _IOFBF, ASYNC_BUF_SIZE);
+
+    af->front = f;
+    af->next = async_files;
+    async_files = af;
+
+    if (!atexit_done) {
+        atexit(async_exit);
+        atexit_done = true;
+    }
+
+    return f;
+}
+
+#else
+
+FILE *nasm_async_file(FILE *back)
+{
+    return back;
+}
+
+#endif
@@ -153,11 +153,99 @@ void nasm_set_binary_mode(FILE *f)
 	os_set_binary_mode(f);
 }
 
+/*
+ * The in-memory input file, if any
+ */
+static const char *memfile_name;
+static const void *memfile_buf;
+static size_t memfile_len;
+
+void nasm_set_memfile(const char *filename, const void *buf, size_t len)
+{
+    memfile_name = filename;
+    memfile_buf  = buf;
+    memfile_len  = len;
+}
+
+static FILE *open_memfile(void)
+{
+    FILE *f;
+
+#ifdef HAVE_FMEMOPEN
+    if (memfile_len)
+        return fmemopen((void *)memfile_buf, memfile_len, "r");
+#endif
+
+    /* Fall back to an anonymous temporary file */
+    f = tmpfile();
+    if (!f)
+        return NULL;
+    if (fwrite(memfile_buf, 1, memfile_len, f) != memfile_len) {
+        fclose(f);
+        return NULL;
+    }
+    rewind(f);
+    return f;
+}
+
+FILE *nasm_membuf_open(struct nasm_membuf *mb)
+{
+    mb->buf = NULL;
+    mb->len = 0;
+#ifdef HAVE_OPEN_MEMSTREAM
+    mb->f = open_memstream(&mb->buf, &mb->len);
+#else
+    mb->f = tmpfile();
+#endif
+    return mb->f;
+}
+
+char *nasm_membuf_close(struct nasm_membuf *mb, size_t *lenp)
+{
+    char *buf;
+    size_t len;
+
+    if (!mb->f) {
+        *lenp = 0;
+        return NULL;
+    }
+
+#ifdef HAVE_OPEN_MEMSTREAM
+    fclose(mb->f);
+    buf = mb->buf;
+    len = mb->len;
+#else
+    fflush(mb->f);
+    fseek(mb->f, 0, SEEK_END);
+    len = ftell(mb->f);
+    rewind(mb->f);
+    buf = malloc(len + 1);
+    if (buf) {
+        len = fread(buf, 1, len, mb->f);
+        buf[len] = '\0';
+    } else {
+        len = 0;
+    }
+    fclose(mb->f);
+#endif
+
+    mb->f   = NULL;
+    mb->buf = NULL;
+    mb->len = 0;
+    *lenp = len;
+    return buf;
+}
+
 FILE *nasm_open_read(const char *filename, enum file_flags flags)
 {
     FILE *f = NULL;
     os_filename osfname;
 
+    if (memfile_name && !strcmp(filename, memfile_name)) {
+        f = open_memfile();
+        goto done;
+    }
+
     osfname = os_mangle_filename(filename);
     if (osfname) {
         os_fopenflag fopen_flags[4];
@@ -187,6 +275,7 @@ FILE *nasm_open_read(const char *filename, enum file_flags flags)
         os_free_filename(osfname);
     }
 
+done:
     if (!f && (flags & NF_FATAL))
         nasm_fatalf(ERR_NOFILE, "unable to open input file: `%s': %s",
                     filename, strerror(errno));
@@ -215,6 +304,11 @@ FILE *nasm_open_write(const char *filename, enum file_flags flags)
         nasm_fatalf(ERR_NOFILE, "unable to open output file: `%s': %s",
                     filename, strerror(errno));
 
+    /* Unbuffered or line buffered files are expected to be up to date */
+    if (f && (flags & NF_ASYNC) &&
+        ((flags & NF_BUF_MASK) == 0 || (flags & NF_BUF_MASK) == NF_IOFBF))
+        return nasm_async_file(f);
+
     switch (flags & NF_BUF_MASK) {
     case NF_IONBF:
         setvbuf(f, NULL, _IONBF, 0);
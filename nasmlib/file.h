@@ -231,4 +231,7 @@ static inline bool S_ISREG(int m)
 }
 #endif
 
+/* Wrap an output file so that it is written by a background thread */
+FILE *nasm_async_file(FILE *f);
+
 #endif /* NASMLIB_FILE_H */
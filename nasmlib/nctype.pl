@@ -0,0 +1,137 @@
+#!/usr/bin/perl
+## --------------------------------------------------------------------------
+##
+##   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+##   See the file AUTHORS included with the NASM distribution for
+##   the specific copyright holders.
+##
+##   Redistribution and use in source and binary forms, with or without
+##   modification, are permitted provided that the following
+##   conditions are met:
+##
+##   * Redistributions of source code must retain the above copyright
+##     notice, this list of conditions and the following disclaimer.
+##   * Redistributions in binary form must reproduce the above
+##     copyright notice, this list of conditions and the following
+##     disclaimer in the documentation and/or other materials provided
+##     with the distribution.
+##
+##     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+##     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+##     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+##     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+##     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+##     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+##     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+##     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+##     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+##     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+##     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+##     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+##     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+##
+## --------------------------------------------------------------------------
+
+#
+# Generate the NASM character class tables as constant data.
+#
+# The classification follows <ctype.h> in the "C" locale (which is
+# what NASM has always run in), plus the NASM-specific classes, so
+# there is nothing left to compute at startup.
+#
+# Usage:
+#      nctype.pl nctype_c.h
+#
+
+use strict;
+
+my($outfile) = @ARGV;
+
+sub iscntrl($)  { my($c) = @_; return $c < 32 || $c == 127; }
+sub isascii($)  { my($c) = @_; return $c < 128; }
+sub isspace($)  { my($c) = @_; return ($c >= 9 && $c <= 13) || $c == 32; }
+sub isupper($)  { my($c) = @_; return $c >= ord('A') && $c <= ord('Z'); }
+sub islower($)  { my($c) = @_; return $c >= ord('a') && $c <= ord('z'); }
+sub isdigit($)  { my($c) = @_; return $c >= ord('0') && $c <= ord('9'); }
+sub isxdigit($) {
+    my($c) = @_;
+    return isdigit($c) || ($c >= ord('A') && $c <= ord('F')) ||
+	($c >= ord('a') && $c <= ord('f'));
+}
+sub ispunct($)  {
+    my($c) = @_;
+    return $c > 32 && $c < 127 && !isupper($c) && !islower($c) &&
+	!isdigit($c);
+}
+
+# NASM-specific additions to the <ctype.h> classes
+my %extra = (
+    '-'  => ['NCT_MINUS'],
+    '$'  => ['NCT_DOLLAR', 'NCT_ID'],
+    '_'  => ['NCT_UNDER', 'NCT_ID', 'NCT_IDSTART'],
+    '.'  => ['NCT_ID', 'NCT_IDSTART'],
+    '@'  => ['NCT_ID', 'NCT_IDSTART'],
+    '?'  => ['NCT_ID', 'NCT_IDSTART'],
+    '#'  => ['NCT_ID'],
+    '~'  => ['NCT_ID'],
+    "'"  => ['NCT_QUOTE'],
+    '"'  => ['NCT_QUOTE'],
+    '`'  => ['NCT_QUOTE'],
+    );
+
+sub ctype($) {
+    my($c) = @_;
+    my @ct;
+
+    push(@ct, 'NCT_CTRL')  if (iscntrl($c));
+    push(@ct, 'NCT_ASCII') if (isascii($c));
+    push(@ct, 'NCT_SPACE') if (isspace($c) && $c != ord("\n"));
+    if (islower($c) || isupper($c)) {
+	push(@ct, islower($c) ? 'NCT_LOWER' : 'NCT_UPPER');
+	push(@ct, 'NCT_ID', 'NCT_IDSTART');
+    }
+    push(@ct, 'NCT_DIGIT', 'NCT_ID') if (isdigit($c));
+    push(@ct, 'NCT_HEX') if (isxdigit($c));
+
+    # Non-ASCII character, but no ctype returned (e.g. Unicode)
+    push(@ct, 'NCT_ID', 'NCT_IDSTART') if (!@ct && !ispunct($c));
+
+    push(@ct, @{$extra{chr($c)}}) if (defined($extra{chr($c)}));
+
+    my %seen;
+    @ct = grep { !$seen{$_}++ } @ct;
+    return @ct ? join('|', @ct) : '0';
+}
+
+sub charname($) {
+    my($c) = @_;
+    return sprintf("0x%02x", $c) if ($c < 33 || $c > 126);
+    return "'\\''" if ($c == ord("'"));
+    return "'\\\\'" if ($c == ord("\\"));
+    return "'".chr($c)."'";
+}
+
+open(my $out, '>', $outfile) or die "$0: cannot create $outfile: $!\n";
+
+print $out "/*\n";
+print $out " * This file is generated by nctype.pl; do not edit.\n";
+print $out " */\n";
+print $out "\n";
+
+print $out "const unsigned char nasm_tolower_tab[256] = {\n";
+for (my $c = 0; $c < 256; $c += 8) {
+    print $out "    ";
+    for (my $i = $c; $i < $c+8; $i++) {
+	printf $out "0x%02x,", isupper($i) ? $i + 32 : $i;
+	print $out ($i == $c+7) ? "\n" : " ";
+    }
+}
+print $out "};\n\n";
+
+print $out "const uint16_t nasm_ctype_tab[256] = {\n";
+for (my $c = 0; $c < 256; $c++) {
+    printf $out "    /* %-6s */ %s,\n", charname($c), ctype($c);
+}
+print $out "};\n";
+
+close($out);
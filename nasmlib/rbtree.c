@@ -114,7 +114,7 @@ static inline bool is_red_right(struct rbtree *h)
 static inline bool is_red_both(struct rbtree *h)
 {
     return !(h->m.flags & (RBTREE_NODE_PRED|RBTREE_NODE_SUCC))
-        && !(h->m.left->m.flags & h->m.right->m.flags & RBTREE_NODE_BLACK);
+        && !((h->m.left->m.flags | h->m.right->m.flags) & RBTREE_NODE_BLACK);
 }
 
 static inline struct rbtree *rotate_left(struct rbtree *h)
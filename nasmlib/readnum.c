@@ -42,39 +42,134 @@
 #include "nasmlib.h"
 #include "error.h"
 #include "nasm.h"               /* For globalbits */
+#include "bytesex.h"
 
-#define lib_isnumchar(c)    (nasm_isalnum(c) || (c) == '$' || (c) == '_')
+/*
+ * Character classes for numeric constants: the digit value (0-35) of
+ * an alphanumeric character, or one of the RN_* values below.  Every
+ * class other than RN_END is part of the number token; any class
+ * >= the radix is an invalid digit.
+ */
+#define RN_SKIP     0x40        /* _ digit separator */
+#define RN_DOLLAR   0x41        /* $ (only valid as a prefix) */
+#define RN_END      0xff        /* Not part of a number */
 
-int64_t readnum(const char *str, bool *error)
+#define S RN_SKIP
+#define D RN_DOLLAR
+#define X RN_END
+static const uint8_t rn_class[256] = {
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, D, X, X, X, X, X, X, X, X, X, X, X,
+     0, 1, 2, 3, 4, 5, 6, 7, 8, 9, X, X, X, X, X, X,
+     X,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,
+    25,26,27,28,29,30,31,32,33,34,35, X, X, X, X, S,
+     X,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,
+    25,26,27,28,29,30,31,32,33,34,35, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+};
+#undef S
+#undef D
+#undef X
+
+#define REP8(x) (UINT64_C(0x0101010101010101) * (x))
+
+static inline uint64_t load8(const char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return cpu_to_le64(v);      /* First character in the low byte */
+}
+
+/*
+ * Convert 8 decimal digits at once.  Returns false, with *val
+ * untouched, if not all of the 8 characters are decimal digits.
+ */
+static inline bool read8_dec(const char *p, uint64_t *val)
+{
+    uint64_t v = load8(p);
+
+    if (((v & REP8(0xf0)) | (((v + REP8(0x06)) & REP8(0xf0)) >> 4))
+        != REP8(0x33))
+        return false;
+
+    v -= REP8('0');
+    v = (v * 10) + (v >> 8);    /* Pairs of digits in every other byte */
+    v = (((v & UINT64_C(0x000000ff000000ff)) *
+          (100 + (UINT64_C(1000000) << 32))) +
+         (((v >> 16) & UINT64_C(0x000000ff000000ff)) *
+          (1 + (UINT64_C(10000) << 32)))) >> 32;
+
+    *val = v;
+    return true;
+}
+
+/*
+ * Convert 8 hexadecimal digits (of either case) at once.  Returns
+ * false, with *val untouched, if not all of the 8 characters are
+ * hexadecimal digits.
+ */
+static inline bool read8_hex(const char *p, uint64_t *val)
 {
-    const char *r = str, *q;
-    int32_t pradix, sradix, radix;
-    int plen, slen, len;
-    uint64_t result, checklimit;
-    int digit, last;
+    const uint64_t hibits = REP8(0x80);
+    uint64_t v = load8(p);
+    uint64_t dig, alpha, lc;
+
+    if (v & hibits)
+        return false;
+
+    dig   = (v + REP8(0x80 - '0')) & ~(v + REP8(0x7f - '9')) & hibits;
+    lc    = v | REP8(0x20);
+    alpha = (lc + REP8(0x80 - 'a')) & ~(lc + REP8(0x7f - 'f')) & hibits;
+    if ((dig | alpha) != hibits)
+        return false;
+
+    v = (v & REP8(0x0f)) + (alpha >> 7) * 9;   /* Nybble values */
+    v = ((v << 4) | (v >> 8)) & UINT64_C(0x00ff00ff00ff00ff);
+    v = ((v << 8) | (v >> 16)) & UINT64_C(0x0000ffff0000ffff);
+    v = ((v << 16) | (v >> 32)) & UINT64_C(0x00000000ffffffff);
+
+    *val = v;
+    return true;
+}
+
+int64_t readnum_len(const char *str, size_t len, bool *error)
+{
+    const char *r = str, *q, *end;
+    unsigned int pradix, sradix, radix, shift;
+    uint64_t result, chunk;
+    unsigned int digit;
     bool warn = false;
     int sign = 1;
 
     if (error)
         *error = true;
 
-    while (nasm_isspace(*r))
+    while ((size_t)(r - str) < len && nasm_isspace(*r))
         r++;                    /* find start of number */
 
     /*
      * If the number came from make_tok_num (as a result of an %assign), it
      * might have a '-' built into it (rather than in a preceding token).
      */
-    if (*r == '-') {
+    if ((size_t)(r - str) < len && *r == '-') {
         r++;
         sign = -1;
     }
 
     q = r;
 
-    while (lib_isnumchar(*q))
+    while ((size_t)(q - str) < len && rn_class[(unsigned char)*q] != RN_END)
         q++;                    /* find end of number */
 
+    end = q;
     len = q-r;
     if (!len) {
 	/* Not numeric */
@@ -89,22 +184,21 @@ int64_t readnum(const char *str, bool *error)
      * <string><radix-letter>
      */
     pradix = sradix = 0;
-    plen = slen = 0;
 
     if (len > 2 && *r == '0' && (pradix = radix_letter(r[1])) != 0)
-	plen = 2;
+	;
     else if (len > 1 && *r == '$')
-	pradix = 16, plen = 1;
+	pradix = 16;
 
-    if (len > 1 && (sradix = radix_letter(q[-1])) != 0)
-	slen = 1;
+    if (len > 1)
+        sradix = radix_letter(q[-1]);
 
     if (pradix > sradix) {
 	radix = pradix;
-	r += plen;
+	r += (*r == '$') ? 1 : 2;
     } else if (sradix > pradix) {
 	radix = sradix;
-	q -= slen;
+	q--;
     } else {
 	/* Either decimal, or invalid -- if invalid, we'll trip up
 	   further down. */
@@ -112,34 +206,43 @@ int64_t readnum(const char *str, bool *error)
     }
 
     /*
-     * `checklimit' must be 2**64 / radix. We can't do that in
-     * 64-bit arithmetic, which we're (probably) using, so we
-     * cheat: since we know that all radices we use are even, we
-     * can divide 2**63 by radix/2 instead.
+     * Accumulate digits, modulo 2^64, taking 8 digits at a time where
+     * possible.  Any value which doesn't fit in 64 bits sets "warn".
      */
-    checklimit = UINT64_C(0x8000000000000000) / (radix >> 1);
+    shift = (radix == 16) ? 4 : (radix == 8) ? 3 : (radix == 2) ? 1 : 0;
+    result = 0;
+    while (r < q) {
+        if (q - r >= 8) {
+            if (radix == 10 && read8_dec(r, &chunk)) {
+                if (result > (UINT64_MAX - chunk) / UINT64_C(100000000))
+                    warn = true;
+                result = result * UINT64_C(100000000) + chunk;
+                r += 8;
+                continue;
+            } else if (radix == 16 && read8_hex(r, &chunk)) {
+                if (result >> 32)
+                    warn = true;
+                result = (result << 32) + chunk;
+                r += 8;
+                continue;
+            }
+        }
 
-    /*
-     * Calculate the highest allowable value for the last digit of a
-     * 64-bit constant... in radix 10, it is 6, otherwise it is 0
-     */
-    last = (radix == 10 ? 6 : 0);
+        digit = rn_class[(unsigned char)*r++];
+        if (digit == RN_SKIP)
+            continue;
+        if (digit >= radix)
+            return 0;
 
-    result = 0;
-    while (*r && r < q) {
-	if (*r != '_') {
-	    if (*r < '0' || (*r > '9' && *r < 'A')
-		|| (digit = numvalue(*r)) >= radix) {
-                return 0;
-	    }
-	    if (result > checklimit ||
-		(result == checklimit && digit >= last)) {
-		warn = true;
-	    }
-
-	    result = radix * result + digit;
-	}
-        r++;
+        if (shift) {
+            if (result >> (64 - shift))
+                warn = true;
+            result = (result << shift) + digit;
+        } else {
+            if (result > (UINT64_MAX - digit) / 10)
+                warn = true;
+            result = result * 10 + digit;
+        }
     }
 
     if (warn) {
@@ -149,11 +252,16 @@ int64_t readnum(const char *str, bool *error)
          *!    don't fit in 64 bits.
          */
         nasm_warn(WARN_NUMBER_OVERFLOW,
-		   "numeric constant %s does not fit in 64 bits",
-		   str);
+		   "numeric constant %.*s does not fit in 64 bits",
+		   (int)(end - str), str);
     }
 
     if (error)
         *error = false;
     return result * sign;
 }
+
+int64_t readnum(const char *str, bool *error)
+{
+    return readnum_len(str, SIZE_MAX, error);
+}
@@ -0,0 +1,204 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * trace.c - write trace events for --enable-trace-events builds
+ *
+ * The trace is written in the JSON array form of the Chrome trace
+ * event format: one object per line, with the timestamps in
+ * microseconds since the trace was opened. The closing bracket is
+ * optional in this format, so a trace cut short by a fatal error can
+ * still be loaded.
+ */
+
+#include "compiler.h"
+#include "nasmlib.h"
+#include "trace.h"
+
+#include <time.h>
+
+#ifdef TRACE_EVENTS
+
+#ifdef HAVE_THREADS
+# include <pthread.h>
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+# define trace_lock()   pthread_mutex_lock(&trace_lock)
+# define trace_unlock() pthread_mutex_unlock(&trace_lock)
+#else
+# define trace_lock()   ((void)0)
+# define trace_unlock() ((void)0)
+#endif
+
+bool trace_active;
+trace_time_t trace_threshold;
+
+static FILE *trace_file;
+static trace_time_t trace_epoch;
+static unsigned int trace_threads;
+static thread_local_var unsigned int trace_tid;
+
+trace_time_t trace_clock(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+        return (trace_time_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    return (trace_time_t)((double)clock() * (1.0e9 / CLOCKS_PER_SEC));
+}
+
+/* Write a string as a JSON string literal */
+static void trace_string(const char *str)
+{
+    unsigned char c;
+
+    putc('\"', trace_file);
+    while ((c = *str++)) {
+        if (c == '\"' || c == '\\')
+            fprintf(trace_file, "\\%c", c);
+        else if (c < ' ')
+            fprintf(trace_file, "\\u%04x", c);
+        else
+            putc(c, trace_file);
+    }
+    putc('\"', trace_file);
+}
+
+/*
+ * Start a new event object; the caller must hold the lock. Threads
+ * are numbered in the order they first write an event.
+ */
+static void trace_start(const char *ph, const char *cat, const char *name,
+                        trace_time_t ts)
+{
+    if (!trace_tid)
+        trace_tid = ++trace_threads;
+
+    fputs(",\n{\"ph\":", trace_file);
+    trace_string(ph);
+    if (cat) {
+        fputs(",\"cat\":", trace_file);
+        trace_string(cat);
+    }
+    if (name) {
+        fputs(",\"name\":", trace_file);
+        trace_string(name);
+    }
+    fprintf(trace_file, ",\"pid\":1,\"tid\":%u,\"ts\":%"PRIu64".%03u",
+            trace_tid, (ts - trace_epoch) / 1000,
+            (unsigned int)((ts - trace_epoch) % 1000));
+}
+
+static void trace_thread_name_locked(const char *name)
+{
+    trace_start("M", NULL, "thread_name", trace_epoch);
+    fputs(",\"args\":{\"name\":", trace_file);
+    trace_string(name);
+    fputs("}}", trace_file);
+}
+
+bool trace_open(const char *filename, trace_time_t threshold)
+{
+    trace_file = nasm_open_write(filename, NF_TEXT|NF_FATAL);
+    trace_epoch = trace_clock();
+    trace_threshold = threshold;
+    trace_active = true;
+
+    trace_lock();
+    fputs("[{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,"
+          "\"args\":{\"name\":\"nasm\"}}", trace_file);
+    trace_thread_name_locked("main");
+    trace_unlock();
+    return true;
+}
+
+void trace_close(void)
+{
+    if (!trace_file)
+        return;
+
+    trace_active = false;
+    fputs("\n]\n", trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+/* Name the calling thread in the trace */
+void trace_thread_name(const char *name)
+{
+    trace_lock();
+    trace_thread_name_locked(name);
+    trace_unlock();
+}
+
+/*
+ * Write a complete span from start until now, unless it was shorter
+ * than min. If arg is not NULL, argval is attached as an argument.
+ */
+void trace_span(const char *cat, const char *name, trace_time_t start,
+                trace_time_t min, const char *arg, int64_t argval)
+{
+    trace_time_t dur = trace_clock() - start;
+
+    if (dur < min)
+        return;
+
+    trace_lock();
+    trace_start("X", cat, name, start);
+    fprintf(trace_file, ",\"dur\":%"PRIu64".%03u",
+            dur / 1000, (unsigned int)(dur % 1000));
+    if (arg) {
+        fputs(",\"args\":{", trace_file);
+        trace_string(arg);
+        fprintf(trace_file, ":%"PRId64"}", argval);
+    }
+    fputs("}", trace_file);
+    trace_unlock();
+}
+
+#else
+
+bool trace_open(const char *filename, trace_time_t threshold)
+{
+    (void)filename;
+    (void)threshold;
+    return false;
+}
+
+void trace_close(void)
+{
+}
+
+#endif /* TRACE_EVENTS */
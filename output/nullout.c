@@ -54,6 +54,12 @@ void null_reset(void)
     /* Nothing to do */
 }
 
+int32_t null_section_switch(int32_t seg, int *bits)
+{
+    (void)bits;
+    return seg;
+}
+
 int32_t null_segbase(int32_t segment)
 {
     return segment;
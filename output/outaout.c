@@ -886,6 +886,7 @@ const struct ofmt of_aout = {
     aout_deflabel,
     aout_section_names,
     NULL,
+    NULL,
     null_sectalign,
     null_segbase,
     null_directive,
@@ -913,6 +914,7 @@ const struct ofmt of_aoutb = {
     aout_deflabel,
     aout_section_names,
     NULL,
+    NULL,
     null_sectalign,
     null_segbase,
     null_directive,
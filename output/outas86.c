@@ -110,6 +110,8 @@ static void as86_sect_write(struct Section *, const uint8_t *,
 
 static void as86_init(void)
 {
+    const char *module;
+
     stext.data = saa_init(1L);
     stext.datalen = 0L;
     stext.head = stext.last = NULL;
@@ -131,7 +133,9 @@ static void as86_init(void)
     strslen = 0;
 
     /* as86 module name = input file minus extension */
-    as86_add_string(filename_set_extension(inname, ""));
+    module = filename_set_extension(inname, "");
+    as86_add_string(module);
+    nasm_free((char *)module);
 }
 
 static void as86_cleanup(void)
@@ -601,6 +605,7 @@ const struct ofmt of_as86 = {
     as86_deflabel,
     as86_section_names,
     NULL,
+    NULL,
     null_sectalign,
     null_segbase,
     null_directive,
@@ -151,6 +151,7 @@ static struct Reloc {
 
 static uint64_t origin;
 static int origin_defined;
+static int section_labels_defined;
 
 /* Stuff we need for map-file generation. */
 #define MAP_ORIGIN       1
@@ -1176,12 +1177,11 @@ static void bin_assign_attributes(struct Section *sec, char *astring)
 
 static void bin_define_section_labels(void)
 {
-    static int labels_defined = 0;
     struct Section *sec;
     char *label_name;
     size_t base_len;
 
-    if (labels_defined)
+    if (section_labels_defined)
         return;
     list_for_each(sec, sections) {
         base_len = strlen(sec->name) + 8;
@@ -1199,7 +1199,7 @@ static void bin_define_section_labels(void)
 
         nasm_free(label_name);
     }
-    labels_defined = 1;
+    section_labels_defined = 1;
 }
 
 static int32_t bin_secname(char *name, int *bits)
@@ -1376,6 +1376,8 @@ static void binfmt_init(void)
     relocs = NULL;
     reloctail = &relocs;
     origin_defined = 0;
+    section_labels_defined = 0;
+    map_control = 0;
     no_seg_labels = NULL;
     nsl_tail = &no_seg_labels;
 
@@ -1613,6 +1615,7 @@ const struct ofmt of_bin = {
     bin_deflabel,
     bin_secname,
     NULL,
+    NULL,
     bin_sectalign,
     null_segbase,
     bin_directive,
@@ -1636,6 +1639,7 @@ const struct ofmt of_ith = {
     bin_deflabel,
     bin_secname,
     NULL,
+    NULL,
     bin_sectalign,
     null_segbase,
     bin_directive,
@@ -1659,6 +1663,7 @@ const struct ofmt of_srec = {
     bin_deflabel,
     bin_secname,
     NULL,
+    NULL,
     bin_sectalign,
     null_segbase,
     bin_directive,
@@ -52,6 +52,7 @@
 #include "outform.h"
 #include "outlib.h"
 #include "pecoff.h"
+#include "trace.h"
 
 #if defined(OF_COFF) || defined(OF_WIN32) || defined(OF_WIN64)
 
@@ -228,10 +229,15 @@ static void coff_cleanup(void)
 {
     struct coff_Reloc *r;
     int i;
+    trace_time_t start;
 
+    TRACE_BEGIN(start);
     dfmt->cleanup();
+    TRACE_END(start, "debug", dfmt->shortname);
 
+    TRACE_BEGIN(start);
     coff_write();
+    TRACE_END(start, "write", ofmt->shortname);
     for (i = 0; i < coff_nsects; i++) {
         if (coff_sects[i]->data)
             saa_free(coff_sects[i]->data);
@@ -1359,6 +1365,7 @@ const struct ofmt of_coff = {
     coff_out,
     coff_deflabel,
     coff_section_names,
+    null_section_switch,
     NULL,
     coff_sectalign,
     null_segbase,
@@ -1396,6 +1403,7 @@ const struct ofmt of_win32 = {
     coff_out,
     coff_deflabel,
     coff_section_names,
+    null_section_switch,
     NULL,
     coff_sectalign,
     null_segbase,
@@ -1425,6 +1433,7 @@ const struct ofmt of_win64 = {
     coff_out,
     coff_deflabel,
     coff_section_names,
+    null_section_switch,
     NULL,
     coff_sectalign,
     null_segbase,
@@ -112,7 +112,9 @@ static int32_t dbg_add_section(char *name, int *bits, const char *whatwecallit)
             if (!strcmp(s->name, sname))
                 seg = s->number;
 
-        if (seg == NO_SEG) {
+        if (seg != NO_SEG) {
+            nasm_free(sname);
+        } else {
             s = nasm_malloc(sizeof(*s));
             s->name = sname;
             s->number = seg = seg_alloc();
@@ -565,6 +567,7 @@ const struct ofmt of_dbg = {
     dbg_legacy_out,
     dbg_deflabel,
     dbg_section_names,
+    NULL,
     dbg_herelabel,
     dbg_sectalign,
     null_segbase,
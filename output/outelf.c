@@ -49,6 +49,7 @@
 #include "outlib.h"
 #include "rbtree.h"
 #include "hashtbl.h"
+#include "trace.h"
 #include "ver.h"
 
 #include "dwarf.h"
@@ -544,10 +545,13 @@ static void elf_init(void)
         ".shstrtab", ".strtab", ".symtab", ".symtab_shndx", NULL
     };
     const char * const *p;
-    const char * cur_path = nasm_realpath(inname);
+    char *cur_path = nasm_realpath(inname);
+    char *cur_dir = nasm_dirname(cur_path);
 
     strlcpy(elf_module, inname, sizeof(elf_module));
-    strlcpy(elf_dir, nasm_dirname(cur_path), sizeof(elf_dir));
+    strlcpy(elf_dir, cur_dir, sizeof(elf_dir));
+    nasm_free(cur_dir);
+    nasm_free(cur_path);
     sects = NULL;
     nsects = sectlen = 0;
     syms = saa_init((int32_t)sizeof(struct elf_symbol));
@@ -558,12 +562,14 @@ static void elf_init(void)
     saa_wbytes(strs, elf_module, strlen(elf_module)+1);
     strslen = 2 + strlen(elf_module);
     shstrtab = NULL;
-    shstrtablen = shstrtabsize = 0;;
+    shstrtablen = shstrtabsize = 0;
+    nsections = 0;
     add_sectname("", "");       /* SHN_UNDEF */
 
     fwds = NULL;
 
     section_by_index = raa_init();
+    hash_free(&section_by_name);    /* Left over if the last run failed */
 
     /*
      * Add reserved section names to the section hash, with NULL
@@ -601,8 +607,11 @@ static void elf_cleanup(void)
 {
     struct elf_reloc *r;
     int i;
+    trace_time_t write_start;
 
+    TRACE_BEGIN(write_start);
     elf_write();
+    TRACE_END(write_start, "write", ofmt->shortname);
     for (i = 0; i < nsects; i++) {
         if (sects[i]->type != SHT_NOBITS)
             saa_free(sects[i]->data);
@@ -613,10 +622,13 @@ static void elf_cleanup(void)
             sects[i]->head = sects[i]->head->next;
             nasm_free(r);
         }
+        nasm_free(sects[i]->name);
+        nasm_free(sects[i]);
     }
     hash_free(&section_by_name);
     raa_free(section_by_index);
     nasm_free(sects);
+    nasm_free(shstrtab);
     saa_free(syms);
     raa_free(bsym);
     saa_free(strs);
@@ -1856,6 +1868,7 @@ static void elf_write(void)
     size_t symtablocal;
     int sec_shstrtab, sec_symtab, sec_strtab;
     union ehdr ehdr;
+    trace_time_t debug_start;
 
     /*
      * Add any sections we don't already have:
@@ -1968,7 +1981,9 @@ static void elf_write(void)
            which are the .stab , .stabstr and .rel.stab sections respectively */
 
         /* this function call creates the stab sections in memory */
+        TRACE_BEGIN(debug_start);
         stabs_generate();
+        TRACE_END(debug_start, "debug", dfmt->shortname);
 
         if (stabbuf && stabstrbuf && stabrelbuf) {
             elf_section_header(p - shstrtab, SHT_PROGBITS, 0, stabbuf, false,
@@ -1990,8 +2005,10 @@ static void elf_write(void)
         /* for dwarf debugging information, create the ten dwarf sections */
 
         /* this function call creates the dwarf sections in memory */
+        TRACE_BEGIN(debug_start);
 	if (dwarf_fsect)
             dwarf_generate();
+        TRACE_END(debug_start, "debug", dfmt->shortname);
 
         elf_section_header(p - shstrtab, SHT_PROGBITS, 0, arangesbuf, false,
                            arangeslen, 0, 0, 1, 0);
@@ -2150,6 +2167,7 @@ static size_t elf_build_symtab(void)
 
     symtab       = saa_init(1);
     symtab_shndx = NULL;
+    nsyms        = 0;
 
     /*
      * Zero symbol first as required by spec.
@@ -2473,6 +2491,7 @@ const struct ofmt of_elf32 = {
     elf32_out,
     elf_deflabel,
     elf_section_names,
+    null_section_switch,
     NULL,
     elf_sectalign,
     null_segbase,
@@ -2531,6 +2550,7 @@ const struct ofmt of_elf64 = {
     elf64_out,
     elf_deflabel,
     elf_section_names,
+    null_section_switch,
     NULL,
     elf_sectalign,
     null_segbase,
@@ -2589,6 +2609,7 @@ const struct ofmt of_elfx32 = {
     elfx32_out,
     elf_deflabel,
     elf_section_names,
+    null_section_switch,
     NULL,
     elf_sectalign,
     null_segbase,
@@ -2976,6 +2997,11 @@ static void stabs_cleanup(void)
     nasm_free(stabbuf);
     nasm_free(stabrelbuf);
     nasm_free(stabstrbuf);
+
+    stabslines = NULL;
+    numlinestabs = 0;
+    stabs_filename = NULL;
+    currentline = 1;
 }
 
 /* dwarf routines */
@@ -2984,6 +3010,10 @@ static void dwarf_init_common(const struct dwarf_format *fmt)
 {
     dwfmt = fmt;
     ndebugs = 3; /* 3 debug symbols */
+
+    dwarf_flist = dwarf_clist = dwarf_elist = NULL;
+    dwarf_fsect = dwarf_csect = dwarf_esect = NULL;
+    dwarf_numfiles = dwarf_nsections = 0;
 }
 
 static void dwarf32_init(void)
@@ -90,7 +90,6 @@ static bool any_segs;
 static int arrindex;
 
 #define HUNKSIZE 1024           /* Size of the data hunk */
-#define EXT_BLKSIZ 512
 #define LDPERLINE 32            /* bytes per line in output */
 
 struct ieeeSection;
@@ -131,10 +130,7 @@ static struct ieeeExternal {
 
 static int externals;
 
-static struct ExtBack {
-    struct ExtBack *next;
-    int index[EXT_BLKSIZ];
-} *ebhead, **ebtail;
+static struct RAA *ext_index;   /* External index by segment index / 2 */
 
 /* NOTE: the first segment MUST be the lineno segment */
 static struct ieeeSection {
@@ -157,6 +153,10 @@ static struct ieeeSection {
     } combine;
 } *seghead, **segtail, *ieee_seg_needs_update;
 
+static struct ol_segmap ieee_segmap;    /* Segments by segment index */
+static struct hash_table ieee_segnames; /* Segments by name */
+static int ieee_nsegs;
+
 struct ieeeObjData {
     struct ieeeObjData *next;
     uint8_t data[HUNKSIZE];
@@ -214,10 +214,12 @@ static void ieee_init(void)
     exthead = NULL;
     exttail = &exthead;
     externals = 1;
-    ebhead = NULL;
-    ebtail = &ebhead;
+    ext_index = NULL;
     seghead = ieee_seg_needs_update = NULL;
     segtail = &seghead;
+    ieee_nsegs = 0;
+    ol_segmap_free(&ieee_segmap);   /* Left over if the last run failed */
+    hash_free(&ieee_segnames);
     ieee_entry_seg = NO_SEG;
     ieee_uppercase = false;
     checksum = 0;
@@ -228,8 +230,15 @@ static void ieee_init(void)
  */
 static void ieee_cleanup(void)
 {
+    struct hash_iterator it;
+    const struct hash_node *np;
+
     ieee_write_file();
     dfmt->cleanup();
+    ol_segmap_free(&ieee_segmap);
+    hash_for_each(&ieee_segnames, it, np)
+        nasm_free((void *)np->key);
+    hash_free(&ieee_segnames);
     while (seghead) {
         struct ieeeSection *segtmp = seghead;
         seghead = seghead->next;
@@ -260,11 +269,7 @@ static void ieee_cleanup(void)
         exthead = exthead->next;
         nasm_free(exttmp);
     }
-    while (ebhead) {
-        struct ExtBack *ebtmp = ebhead;
-        ebhead = ebhead->next;
-        nasm_free(ebtmp);
-    }
+    raa_free(ext_index);
 }
 
 /*
@@ -288,9 +293,7 @@ static void ieee_deflabel(char *name, int32_t segment,
      * position for later output of an EXTDEF.
      */
     struct ieeeExternal *ext;
-    struct ExtBack *eb;
     struct ieeeSection *seg;
-    int i;
 
     if (special)
         nasm_nonfatal("unrecognised symbol type `%s'", special);
@@ -336,19 +339,19 @@ static void ieee_deflabel(char *name, int32_t segment,
         return;
     }
 
-    for (seg = seghead; seg && is_global; seg = seg->next)
-        if (seg->index == segment) {
-            struct ieeePublic *pub;
-
-            last_defined = pub = *seg->pubtail = nasm_malloc(sizeof(*pub));
-            seg->pubtail = &pub->next;
-            pub->next = NULL;
-            pub->name = name;
-            pub->offset = offset;
-            pub->index = seg->ieee_index;
-            pub->segment = -1;
-            return;
-        }
+    seg = is_global ? ol_segmap_get(&ieee_segmap, segment) : NULL;
+    if (seg) {
+        struct ieeePublic *pub;
+
+        last_defined = pub = *seg->pubtail = nasm_malloc(sizeof(*pub));
+        seg->pubtail = &pub->next;
+        pub->next = NULL;
+        pub->name = name;
+        pub->offset = offset;
+        pub->index = seg->ieee_index;
+        pub->segment = -1;
+        return;
+    }
 
     /*
      * Case (iii).
@@ -362,24 +365,7 @@ static void ieee_deflabel(char *name, int32_t segment,
             ext->commonsize = offset;
         else
             ext->commonsize = 0;
-        i = segment / 2;
-        eb = ebhead;
-        if (!eb) {
-            eb = *ebtail = nasm_zalloc(sizeof(*eb));
-            eb->next = NULL;
-            ebtail = &eb->next;
-        }
-        while (i > EXT_BLKSIZ) {
-            if (eb && eb->next)
-                eb = eb->next;
-            else {
-                eb = *ebtail = nasm_zalloc(sizeof(*eb));
-                eb->next = NULL;
-                ebtail = &eb->next;
-            }
-            i -= EXT_BLKSIZ;
-        }
-        eb->index[i] = externals++;
+        ext_index = raa_write(ext_index, segment / 2, externals++);
     }
 
 }
@@ -408,9 +394,7 @@ static void ieee_out(int32_t segto, const void *data,
     /*
      * Find the segment we are targeting.
      */
-    for (seg = seghead; seg; seg = seg->next)
-        if (seg->index == segto)
-            break;
+    seg = ol_segmap_get(&ieee_segmap, segto);
     if (!seg)
         nasm_panic("code directed to nonexistent segment?");
 
@@ -481,15 +465,10 @@ static void ieee_write_fixup(int32_t segment, int32_t wrt,
                 && realtype != OUT_REL4ADR) {
                 wrt--;
 
-                for (target = seghead; target; target = target->next)
-                    if (target->index == wrt)
-                        break;
+                target = ol_segmap_get(&ieee_segmap, wrt);
                 if (target) {
                     s.id1 = target->ieee_index;
-                    for (target = seghead; target; target = target->next)
-                        if (target->index == segment)
-                            break;
-
+                    target = ol_segmap_get(&ieee_segmap, segment);
                     if (target)
                         s.id2 = target->ieee_index;
                     else {
@@ -497,21 +476,13 @@ static void ieee_write_fixup(int32_t segment, int32_t wrt,
                          * Now we assume the segment field is being used
                          * to hold an extern index
                          */
-                        int32_t i = segment / 2;
-                        struct ExtBack *eb = ebhead;
-                        while (i > EXT_BLKSIZ) {
-                            if (eb)
-                                eb = eb->next;
-                            else
-                                break;
-                            i -= EXT_BLKSIZ;
-                        }
+                        int32_t ext = raa_read(ext_index, segment / 2);
                         /* if we have an extern decide the type and make a record
                          */
-                        if (eb) {
+                        if (ext) {
                             s.ftype = FT_EXTWRT;
                             s.addend = 0;
-                            s.id2 = eb->index[i];
+                            s.id2 = ext;
                         } else
                             nasm_nonfatal("source of WRT must be an offset");
                     }
@@ -535,9 +506,7 @@ static void ieee_write_fixup(int32_t segment, int32_t wrt,
         } else if (segment % 2) {
             /* fixup to named segment */
             /* look it up */
-            for (target = seghead; target; target = target->next)
-                if (target->index == segment - 1)
-                    break;
+            target = ol_segmap_get(&ieee_segmap, segment - 1);
             if (target)
                 s.id1 = target->ieee_index;
             else {
@@ -545,25 +514,17 @@ static void ieee_write_fixup(int32_t segment, int32_t wrt,
                  * Now we assume the segment field is being used
                  * to hold an extern index
                  */
-                int32_t i = segment / 2;
-                struct ExtBack *eb = ebhead;
-                while (i > EXT_BLKSIZ) {
-                    if (eb)
-                        eb = eb->next;
-                    else
-                        break;
-                    i -= EXT_BLKSIZ;
-                }
+                int32_t ext = raa_read(ext_index, segment / 2);
                 /* if we have an extern decide the type and make a record
                  */
-                if (eb) {
+                if (ext) {
                     if (realtype == OUT_REL2ADR || realtype == OUT_REL4ADR) {
                         nasm_panic("Segment of a rel not supported in ieee_write_fixup");
                     } else {
                         /* If we want the segment */
                         s.ftype = FT_EXTSEG;
                         s.addend = 0;
-                        s.id1 = eb->index[i];
+                        s.id1 = ext;
                     }
 
                 } else
@@ -575,9 +536,7 @@ static void ieee_write_fixup(int32_t segment, int32_t wrt,
             /* Assume we are offsetting directly from a section
              * So look up the target segment
              */
-            for (target = seghead; target; target = target->next)
-                if (target->index == segment)
-                    break;
+            target = ol_segmap_get(&ieee_segmap, segment);
             if (target) {
                 if (realtype == OUT_REL2ADR || realtype == OUT_REL4ADR) {
                     /* PC rel to a known offset */
@@ -597,27 +556,19 @@ static void ieee_write_fixup(int32_t segment, int32_t wrt,
                  * Now we assume the segment field is being used
                  * to hold an extern index
                  */
-                int32_t i = segment / 2;
-                struct ExtBack *eb = ebhead;
-                while (i > EXT_BLKSIZ) {
-                    if (eb)
-                        eb = eb->next;
-                    else
-                        break;
-                    i -= EXT_BLKSIZ;
-                }
+                int32_t ext = raa_read(ext_index, segment / 2);
                 /* if we have an extern decide the type and make a record
                  */
-                if (eb) {
+                if (ext) {
                     if (realtype == OUT_REL2ADR || realtype == OUT_REL4ADR) {
                         s.ftype = FT_EXTREL;
                         s.addend = 0;
-                        s.id1 = eb->index[i];
+                        s.id1 = ext;
                     } else {
                         /* else we want the external offset */
                         s.ftype = FT_EXT;
                         s.addend = 0;
-                        s.id1 = eb->index[i];
+                        s.id1 = ext;
                     }
 
                 } else
@@ -668,10 +619,11 @@ static int32_t ieee_segment(char *name, int *bits)
             return 0;
         return seghead->index;
     } else {
-        struct ieeeSection *seg;
-        int ieee_idx, attrs;
+        struct ieeeSection *seg, **segp;
+        struct hash_insert hi;
+        int attrs;
 	bool rn_error;
-        char *p;
+        char *p, *segname;
 
         /*
          * Look for segment attributes.
@@ -699,28 +651,29 @@ static int32_t ieee_segment(char *name, int *bits)
             attrs++;
         }
 
-        ieee_idx = 1;
-        for (seg = seghead; seg; seg = seg->next) {
-            ieee_idx++;
-            if (!strcmp(seg->name, name)) {
-                if (attrs > 0 && seg->pass_last_seen == pass_count())
-                    nasm_warn(WARN_OTHER, "segment attributes specified on"
-                              " redeclaration of segment: ignoring");
-                if (seg->use32)
-                    *bits = 32;
-                else
-                    *bits = 16;
+        segp = (struct ieeeSection **)hash_find(&ieee_segnames, name, &hi);
+        if (segp) {
+            seg = *segp;
+            if (attrs > 0 && seg->pass_last_seen == pass_count())
+                nasm_warn(WARN_OTHER, "segment attributes specified on"
+                          " redeclaration of segment: ignoring");
+            if (seg->use32)
+                *bits = 32;
+            else
+                *bits = 16;
 
-                seg->pass_last_seen = pass_count();
-                return seg->index;
-            }
+            seg->pass_last_seen = pass_count();
+            return seg->index;
         }
 
         *segtail = seg = nasm_malloc(sizeof(*seg));
         seg->next = NULL;
         segtail = &seg->next;
         seg->index = seg_alloc();
-        seg->ieee_index = ieee_idx;
+        seg->ieee_index = ++ieee_nsegs;
+        ol_segmap_add(&ieee_segmap, seg->index, seg);
+        segname = nasm_strdup(name);
+        hash_add(&hi, segname, seg);
         any_segs = true;
         seg->name = NULL;
         seg->currentpos = 0;
@@ -806,11 +759,11 @@ static int32_t ieee_segment(char *name, int *bits)
          *
          * FIXME: Need to revisit this moment if such fix doesn't
          * break anything but since IEEE 695 format is veeery
-         * old I don't expect there are many users left. In worst
-         * case this should only lead to a memory leak.
+         * old I don't expect there are many users left.  The
+         * name is borrowed from the segment hash, which owns it.
          */
         if (!seg->name)
-            seg->name = nasm_strdup(name);
+            seg->name = segname;
 
         if (seg->use32)
             *bits = 32;
@@ -870,10 +823,7 @@ static int32_t ieee_segbase(int32_t segment)
     /*
      * Find the segment in our list.
      */
-    for (seg = seghead; seg; seg = seg->next)
-        if (seg->index == segment - 1)
-            break;
-
+    seg = ol_segmap_get(&ieee_segmap, segment - 1);
     if (!seg)
         return segment;         /* not one of ours - leave it alone */
 
@@ -972,9 +922,7 @@ static void ieee_write_file(void)
      * write the start address if there is one
      */
     if (ieee_entry_seg && seghead) {
-        for (seg = seghead; seg; seg = seg->next)
-            if (seg->index == ieee_entry_seg)
-                break;
+        seg = ol_segmap_get(&ieee_segmap, ieee_entry_seg);
         if (!seg)
             nasm_panic("Start address records are incorrect");
         else
@@ -1511,6 +1459,7 @@ const struct ofmt of_ieee = {
     ieee_deflabel,
     ieee_segment,
     NULL,
+    NULL,
     ieee_sectalign,
     ieee_segbase,
     ieee_directive,
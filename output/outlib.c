@@ -38,7 +38,6 @@
  */
 
 #include "outlib.h"
-#include "raa.h"
 
 uint64_t realsize(enum out_type type, uint64_t size)
 {
@@ -143,6 +142,7 @@ struct ol_sect *_ol_get_sect(const char *name, size_t ssize, size_t rsize)
 
     s             = nasm_zalloc(ssize);
     s->syml.tail  = &s->syml.head;
+    s->symg.tail  = &s->symg.head;
     s->name       = nasm_strdup(name);
     s->data       = saa_init(1);
     s->reloc      = saa_init(rsize);
@@ -322,3 +322,32 @@ struct ol_sym *_ol_sym_by_address(struct ol_sect *sect, int64_t addr,
 
     return (struct ol_sym *)((char *)t - t_offs);
 }
+
+/*
+ * Segment index map for backends with their own section structures.
+ * Segment indices from seg_alloc() are always even, so the low bit is
+ * dropped to keep the table dense.
+ */
+void ol_segmap_add(struct ol_segmap *map, int32_t index, void *ptr)
+{
+    uint32_t ix = index;
+
+    nasm_assert(ix < SEG_ABS && !(ix & 1));
+    map->raa = raa_write_ptr(map->raa, ix >> 1, ptr);
+}
+
+void *ol_segmap_get(const struct ol_segmap *map, int32_t index)
+{
+    uint32_t ix = index;
+
+    if (unlikely(ix >= SEG_ABS || (ix & 1)))
+        return NULL;
+
+    return raa_read_ptr(map->raa, ix >> 1);
+}
+
+void ol_segmap_free(struct ol_segmap *map)
+{
+    raa_free(map->raa);
+    map->raa = NULL;
+}
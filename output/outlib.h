@@ -39,6 +39,7 @@
 #include "error.h"
 #include "hashtbl.h"
 #include "saa.h"
+#include "raa.h"
 #include "rbtree.h"
 
 uint64_t realsize(enum out_type type, uint64_t size);
@@ -48,6 +49,7 @@ enum directive_result
 null_directive(enum directive directive, char *value);
 void null_sectalign(int32_t seg, unsigned int value);
 void null_reset(void);
+int32_t null_section_switch(int32_t seg, int *bits);
 int32_t null_segbase(int32_t seg);
 
 /* Do-nothing versions of all the debug routines */
@@ -310,4 +312,17 @@ static inline uint64_t ol_nsyms(void)
     return _ol_nsyms;
 }
 
+/*
+ * Segment index map, for backends which keep their own section or
+ * group structures: find the structure for a segment index without
+ * walking a list.  Only indices returned by seg_alloc() can be added;
+ * looking up anything else returns NULL.
+ */
+struct ol_segmap {
+    struct RAA *raa;
+};
+void ol_segmap_add(struct ol_segmap *map, int32_t index, void *ptr);
+void *ol_segmap_get(const struct ol_segmap *map, int32_t index);
+void ol_segmap_free(struct ol_segmap *map);
+
 #endif /* NASM_OUTLIB_H */
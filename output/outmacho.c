@@ -49,6 +49,7 @@
 #include "raa.h"
 #include "rbtree.h"
 #include "hashtbl.h"
+#include "trace.h"
 #include "outform.h"
 #include "outlib.h"
 #include "ver.h"
@@ -347,6 +348,7 @@ static void macho_init(void)
     sectstail = &sects;
 
     /* Fake section for absolute symbols */
+    nasm_zero(absolute_sect);
     absolute_sect.index = NO_SEG;
 
     syms = NULL;
@@ -356,10 +358,19 @@ static void macho_init(void)
     nextdefsym = 0;
     nundefsym = 0;
 
+    /* Layout state accumulates; start over for each assembly */
+    head_ncmds = head_sizeofcmds = head_flags = 0;
+    seg_filesize = seg_vmsize = 0;
+    seg_nsects = 0;
+    rel_padcnt = 0;
+    extdefsyms = undefsyms = NULL;
+    sectstab = NULL;
+
     extsyms = raa_init();
     strs = saa_init(1L);
 
     section_by_index = raa_init();
+    hash_free(&section_by_name);    /* Left over if the last run failed */
 
     /* string table starts with a zero byte so index 0 is an empty string */
     saa_wbytes(strs, zero_buffer, 1);
@@ -941,6 +952,19 @@ static int32_t macho_section(char *name, int *bits)
     return s->subsection;
 }
 
+/*
+ * A repeated section specifier: the section exists and its attributes
+ * have already been applied, but labels may have opened a new
+ * subsection since, so return the current one.
+ */
+static int32_t macho_section_switch(int32_t seg, int *bits)
+{
+    struct section *s = get_section_by_index(seg);
+    (void)bits;
+
+    return s ? s->subsection : seg;
+}
+
 static int32_t macho_herelabel(const char *name, enum label_type type,
 			       int32_t section, int32_t *subsection,
 			       bool *copyoffset)
@@ -1687,8 +1711,13 @@ static void macho_cleanup(void)
     struct section *s;
     struct reloc *r;
     struct symbol *sym;
+    trace_time_t start;
 
+    TRACE_BEGIN(start);
     dfmt->cleanup();
+    TRACE_END(start, "debug", dfmt->shortname);
+
+    TRACE_BEGIN(start);
 
     /* Sort all symbols.  */
     macho_layout_symbols (&nsyms, &strslen);
@@ -1701,9 +1730,10 @@ static void macho_cleanup(void)
     /* First calculate and finalize needed values.  */
     macho_calculate_sizes();
     macho_write();
+    TRACE_END(start, "write", ofmt->shortname);
 
     /* free up everything */
-    while (sects->next) {
+    while (sects) {
         s = sects;
         sects = sects->next;
 
@@ -2112,6 +2142,12 @@ static void new_file_list (const char *file_name, const char *dir_name)
 
 static void macho_dbg_init(void)
 {
+    dw_head_file = dw_cur_file = NULL;
+    dw_last_file_next = NULL;
+    dw_head_dir = NULL;
+    dw_last_dir_next = NULL;
+    dw_head_sect = dw_cur_sect = dw_last_sect = NULL;
+    cur_line = dw_num_files = dw_num_dirs = dw_num_sects = 0;
 }
 
 static void macho_dbg_linenum(const char *file_name, int32_t line_num, int32_t segto)
@@ -2321,6 +2357,7 @@ const struct ofmt of_macho32 = {
     macho_output,
     macho_symdef,
     macho_section,
+    macho_section_switch,
     macho_herelabel,
     macho_sectalign,
     null_segbase,
@@ -2391,6 +2428,7 @@ const struct ofmt of_macho64 = {
     macho_output,
     macho_symdef,
     macho_section,
+    macho_section_switch,
     macho_herelabel,
     macho_sectalign,
     null_segbase,
@@ -513,7 +513,6 @@ static int arrindex;
 
 #define GROUP_MAX 256           /* we won't _realistically_ have more
                                  * than this many segs in a group */
-#define EXT_BLKSIZ 256          /* block size for externals list */
 
 struct Segment;                 /* need to know these structs exist */
 struct Group;
@@ -570,10 +569,7 @@ static struct External {
 
 static int externals;
 
-static struct ExtBack {
-    struct ExtBack *next;
-    struct External *exts[EXT_BLKSIZ];
-} *ebhead, **ebtail;
+static struct ol_segmap obj_extmap;    /* Externals by segment index */
 
 static struct Segment {
     struct Segment *next;
@@ -609,6 +605,11 @@ static struct Group {
     } segs[GROUP_MAX];          /* ...in this */
 } *grphead, **grptail, *obj_grp_needs_update;
 
+static struct ol_segmap obj_segmap;    /* Segments by segment index */
+static struct ol_segmap obj_grpmap;    /* Groups by segment index */
+static struct hash_table obj_segnames; /* Segments by name */
+static int obj_nsegs;
+
 static struct ImpDef {
     struct ImpDef *next;
     char *extname;
@@ -657,23 +658,36 @@ static void obj_init(void)
     exptail = &exphead;
     dws = NULL;
     externals = 0;
-    ebhead = NULL;
-    ebtail = &ebhead;
     seghead = obj_seg_needs_update = NULL;
     segtail = &seghead;
+    obj_nsegs = 0;
+    ol_segmap_free(&obj_segmap);    /* Left over if the last run failed */
+    ol_segmap_free(&obj_grpmap);
+    ol_segmap_free(&obj_extmap);
+    hash_free(&obj_segnames);
     grphead = obj_grp_needs_update = NULL;
     grptail = &grphead;
     obj_entry_seg = NO_SEG;
     obj_uppercase = false;
     obj_use32 = false;
+    obj_nodepend = false;
     passtwo = 0;
     current_seg = NULL;
 }
 
 static void obj_cleanup(void)
 {
+    struct hash_iterator it;
+    const struct hash_node *np;
+
     obj_write_file();
     dfmt->cleanup();
+    ol_segmap_free(&obj_segmap);
+    ol_segmap_free(&obj_grpmap);
+    ol_segmap_free(&obj_extmap);
+    hash_for_each(&obj_segnames, it, np)
+        nasm_free((void *)np->key);
+    hash_free(&obj_segnames);
     while (seghead) {
         struct Segment *segtmp = seghead;
         seghead = seghead->next;
@@ -713,11 +727,6 @@ static void obj_cleanup(void)
         nasm_free(exptmp->intname);
         nasm_free(exptmp);
     }
-    while (ebhead) {
-        struct ExtBack *ebtmp = ebhead;
-        ebhead = ebhead->next;
-        nasm_free(ebtmp);
-    }
     while (grphead) {
         struct Group *grptmp = grphead;
         grphead = grphead->next;
@@ -772,9 +781,7 @@ static void obj_deflabel(char *name, int32_t segment,
      * segment number to the external index.
      */
     struct External *ext;
-    struct ExtBack *eb;
     struct Segment *seg;
-    int i;
     bool used_special = false;   /* have we used the special text? */
 
     if (debug_level(2))
@@ -844,23 +851,23 @@ static void obj_deflabel(char *name, int32_t segment,
             nasm_panic("strange segment conditions in OBJ driver");
     }
 
-    for (seg = seghead; seg && is_global; seg = seg->next)
-        if (seg->index == segment) {
-            struct Public *loc = nasm_malloc(sizeof(*loc));
-            /*
-             * Case (ii). Maybe MODPUB someday?
-             */
-            *seg->pubtail = loc;
-            seg->pubtail = &loc->next;
-            loc->next = NULL;
-            loc->name = nasm_strdup(name);
-            loc->offset = offset;
+    seg = is_global ? ol_segmap_get(&obj_segmap, segment) : NULL;
+    if (seg) {
+        struct Public *loc = nasm_malloc(sizeof(*loc));
+        /*
+         * Case (ii). Maybe MODPUB someday?
+         */
+        *seg->pubtail = loc;
+        seg->pubtail = &loc->next;
+        loc->next = NULL;
+        loc->name = nasm_strdup(name);
+        loc->offset = offset;
 
-            if (special)
-                nasm_nonfatal("OBJ supports no special symbol features"
-                              " for this symbol type");
-            return;
-        }
+        if (special)
+            nasm_nonfatal("OBJ supports no special symbol features"
+                          " for this symbol type");
+        return;
+    }
 
     /*
      * Case (iii).
@@ -987,24 +994,7 @@ static void obj_deflabel(char *name, int32_t segment,
         }
     }
 
-    i = segment / 2;
-    eb = ebhead;
-    if (!eb) {
-        eb = *ebtail = nasm_zalloc(sizeof(*eb));
-        eb->next = NULL;
-        ebtail = &eb->next;
-    }
-    while (i >= EXT_BLKSIZ) {
-        if (eb && eb->next)
-            eb = eb->next;
-        else {
-            eb = *ebtail = nasm_zalloc(sizeof(*eb));
-            eb->next = NULL;
-            ebtail = &eb->next;
-        }
-        i -= EXT_BLKSIZ;
-    }
-    eb->exts[i] = ext;
+    ol_segmap_add(&obj_extmap, segment, ext);
     ext->index = ++externals;
 
     if (special && !used_special)
@@ -1039,9 +1029,7 @@ static void obj_out(int32_t segto, const void *data,
     /*
      * Find the segment we are targeting.
      */
-    for (seg = seghead; seg; seg = seg->next)
-        if (seg->index == segto)
-            break;
+    seg = ol_segmap_get(&obj_segmap, segto);
     if (!seg)
         nasm_panic("code directed to nonexistent segment?");
 
@@ -1232,29 +1220,17 @@ static void obj_write_fixup(ObjRecord * orp, int bytes,
      * See if we can find the segment ID in our segment list. If
      * so, we have a T4 (LSEG) target.
      */
-    for (s = seghead; s; s = s->next)
-        if (s->index == seg)
-            break;
+    s = ol_segmap_get(&obj_segmap, seg);
     if (s)
         method = 4, tidx = s->obj_index;
     else {
-        for (g = grphead; g; g = g->next)
-            if (g->index == seg)
-                break;
+        g = ol_segmap_get(&obj_grpmap, seg);
         if (g)
             method = 5, tidx = g->obj_index;
         else {
-            int32_t i = seg / 2;
-            struct ExtBack *eb = ebhead;
-            while (i >= EXT_BLKSIZ) {
-                if (eb)
-                    eb = eb->next;
-                else
-                    break;
-                i -= EXT_BLKSIZ;
-            }
-            if (eb)
-                method = 6, e = eb->exts[i], tidx = e->index;
+            e = ol_segmap_get(&obj_extmap, seg & ~1);
+            if (e)
+                method = 6, tidx = e->index;
             else
                 nasm_panic("unrecognised segment value in obj_write_fixup");
         }
@@ -1290,29 +1266,17 @@ static void obj_write_fixup(ObjRecord * orp, int bytes,
          * See if we can find the WRT-segment ID in our segment
          * list. If so, we have a F0 (LSEG) frame.
          */
-        for (s = seghead; s; s = s->next)
-            if (s->index == wrt - 1)
-                break;
+        s = ol_segmap_get(&obj_segmap, wrt - 1);
         if (s)
             method |= 0x00, fidx = s->obj_index;
         else {
-            for (g = grphead; g; g = g->next)
-                if (g->index == wrt - 1)
-                    break;
+            g = ol_segmap_get(&obj_grpmap, wrt - 1);
             if (g)
                 method |= 0x10, fidx = g->obj_index;
             else {
-                int32_t i = wrt / 2;
-                struct ExtBack *eb = ebhead;
-                while (i >= EXT_BLKSIZ) {
-                    if (eb)
-                        eb = eb->next;
-                    else
-                        break;
-                    i -= EXT_BLKSIZ;
-                }
-                if (eb)
-                    method |= 0x20, fidx = eb->exts[i]->index;
+                struct External *we = ol_segmap_get(&obj_extmap, wrt & ~1);
+                if (we)
+                    method |= 0x20, fidx = we->index;
                 else
                     nasm_panic("unrecognised WRT value in obj_write_fixup");
             }
@@ -1343,12 +1307,13 @@ static int32_t obj_segment(char *name, int *bits)
         current_seg = NULL;
         return first_seg;
     } else {
-        struct Segment *seg;
+        struct Segment *seg, **segp;
         struct Group *grp;
         struct External **extp;
+        struct hash_insert hi;
         int obj_idx, i, attrs;
 	bool rn_error;
-        char *p;
+        char *p, *segname;
 
         /*
          * Look for segment attributes.
@@ -1376,32 +1341,33 @@ static int32_t obj_segment(char *name, int *bits)
             attrs++;
         }
 
-        for (seg = seghead, obj_idx = 1; ; seg = seg->next, obj_idx++) {
-            if (!seg)
-                break;
-
-            if (!strcmp(seg->name, name)) {
-                if (attrs > 0 && seg->pass_last_seen == pass_count())
-                    nasm_warn(WARN_OTHER, "segment attributes specified on"
-                              " redeclaration of segment: ignoring");
-                if (seg->use32)
-                    *bits = 32;
-                else
-                    *bits = 16;
-                current_seg = seg;
-                seg->pass_last_seen = pass_count();
-                return seg->index;
-            }
+        segp = (struct Segment **)hash_find(&obj_segnames, name, &hi);
+        if (segp) {
+            seg = *segp;
+            if (attrs > 0 && seg->pass_last_seen == pass_count())
+                nasm_warn(WARN_OTHER, "segment attributes specified on"
+                          " redeclaration of segment: ignoring");
+            if (seg->use32)
+                *bits = 32;
+            else
+                *bits = 16;
+            current_seg = seg;
+            seg->pass_last_seen = pass_count();
+            return seg->index;
         }
 
+        obj_idx = ++obj_nsegs;
         *segtail = seg = nasm_malloc(sizeof(*seg));
         seg->next = NULL;
         segtail = &seg->next;
         seg->index = (any_segs ? seg_alloc() : first_seg);
         seg->obj_index = obj_idx;
+        ol_segmap_add(&obj_segmap, seg->index, seg);
+        segname = nasm_strdup(name);
+        hash_add(&hi, segname, seg);
         seg->grp = NULL;
         any_segs = true;
-        seg->name = nasm_strdup(name);
+        seg->name = segname;    /* Owned by obj_segnames */
         seg->currentpos = 0;
         seg->align = 1;         /* default */
         seg->use32 = false;     /* default */
@@ -1622,6 +1588,7 @@ obj_directive(enum directive directive, char *value)
             grptail = &grp->next;
             grp->index = seg_alloc();
             grp->obj_index = obj_idx;
+            ol_segmap_add(&obj_grpmap, grp->index, grp);
             grp->nindices = grp->nentries = 0;
             grp->name = NULL;
 
@@ -1867,33 +1834,14 @@ static int32_t obj_segbase(int32_t segment)
     /*
      * Find the segment in our list.
      */
-    for (seg = seghead; seg; seg = seg->next)
-        if (seg->index == segment - 1)
-            break;
-
+    seg = ol_segmap_get(&obj_segmap, segment - 1);
     if (!seg) {
         /*
          * Might be an external with a default WRT.
          */
-        int32_t i = segment / 2;
-        struct ExtBack *eb = ebhead;
-        struct External *e;
-
-        while (i >= EXT_BLKSIZ) {
-            if (eb)
-                eb = eb->next;
-            else
-                break;
-            i -= EXT_BLKSIZ;
-        }
-        if (eb) {
-            e = eb->exts[i];
-	    if (!e) {
-                /* Not available yet, probably a forward reference */
-		nasm_assert(!pass_final());
-		return NO_SEG;
-	    }
+        struct External *e = ol_segmap_get(&obj_extmap, segment & ~1);
 
+        if (e) {
 	    switch (e->defwrt_type) {
 	    case DEFWRT_NONE:
                 return segment; /* fine */
@@ -1906,6 +1854,17 @@ static int32_t obj_segbase(int32_t segment)
 	    }
         }
 
+        /*
+         * Externals have even segment numbers, and only reach us from
+         * the stabilization pass on; once some have, an even number we
+         * don't know yet is an external declared further down.
+         */
+        if (obj_extmap.raa && !(segment & 1) && (uint32_t)segment < SEG_ABS) {
+            /* Not available yet, probably a forward reference */
+            nasm_assert(!pass_final());
+            return NO_SEG;
+        }
+
         return segment;         /* not one of ours - leave it alone */
     }
 
@@ -2692,6 +2651,7 @@ const struct ofmt of_obj = {
     obj_deflabel,
     obj_segment,
     NULL,
+    NULL,
     obj_sectalign,
     obj_segbase,
     obj_directive,
@@ -0,0 +1,291 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2024 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * libtest.c - repeated use of the in-memory assembly library API
+ *
+ * Assembles the same source with nasm_assemble_buffer() many times
+ * for each output format below, and checks that every call succeeds and
+ * returns the same output image and diagnostics as the first one.
+ * Options which would exit the process must fail the call instead.
+ * "make lib-test" builds and runs this program.
+ *
+ * Usage: libtest [-n count] [format...]
+ *
+ * Built with AddressSanitizer (or LeakSanitizer alone), the leak
+ * checker is run after each format, so memory which a session fails
+ * to free is reported against that format, and makes the test fail.
+ */
+
+#include "compiler.h"
+
+#include "nasmlib.h"
+#include "libnasm.h"
+
+#ifndef __has_feature
+# define __has_feature(x) 0
+#endif
+#if defined(__SANITIZE_ADDRESS__) || __has_feature(address_sanitizer) || \
+    __has_feature(leak_sanitizer)
+# include <sanitizer/lsan_interface.h>
+# define leak_check() __lsan_do_recoverable_leak_check()
+#else
+# define leak_check() 0
+#endif
+
+static const char source[] =
+    "%if __?BITS?__ == 64\n"
+    "  default rel\n"
+    "  %define dp dq\n"
+    "%else\n"
+    "  %define dp dd\n"
+    "%endif\n"
+    "%macro fn 1\n"
+    "  global %1\n"
+    "%1:\n"
+    "  lea eax, [%%data]\n"
+    "  call %%next\n"
+    "%%next:\n"
+    "  ret\n"
+    "  section .data\n"
+    "%%data: dp %1, ext, $\n"
+    "  section .text\n"
+    "%endmacro\n"
+    "%ifidn __?OUTPUT_FORMAT?__, bin\n"
+    "  %define ext 0\n"
+    "%else\n"
+    "  extern ext\n"
+    "%endif\n"
+    "  section .text\n"
+    "%assign i 0\n"
+    "%rep 20\n"
+    "  fn f %+ i\n"
+    "  jmp near fwd\n"
+    "%assign i i+1\n"
+    "%endrep\n"
+    "fwd:\n"
+    "  section .bss\n"
+    "  resb 64\n"
+    "  section .text\n"
+    "  db 'done', 0\n"
+    "%warning last line\n";
+
+/*
+ * The IEEE backend wants a start address, and cannot take a
+ * relocation as the first item in a section.
+ */
+static const char ieee_source[] =
+    "%macro fn 1\n"
+    "  global %1\n"
+    "%1:\n"
+    "  mov eax, %%data\n"
+    "  call %%next\n"
+    "%%next:\n"
+    "  ret\n"
+    "  section data\n"
+    "%%data: db 1\n"
+    "  dd %1\n"
+    "  section code\n"
+    "%endmacro\n"
+    "  extern ext\n"
+    "  section code\n"
+    "..start:\n"
+    "%assign i 0\n"
+    "%rep 20\n"
+    "  fn f %+ i\n"
+    "  jmp near fwd\n"
+    "%assign i i+1\n"
+    "%endrep\n"
+    "fwd:\n"
+    "  section data\n"
+    "  dd ext\n"
+    "  section code\n"
+    "  db 'done', 0\n"
+    "%warning last line\n";
+
+/* Formats to test, the BITS to use, and the source to assemble */
+static const struct test_format {
+    const char *name;
+    const char *bits;
+    const char *source;
+    size_t len;
+} formats[] = {
+    { "elf32",   "32", source, sizeof source - 1 },
+    { "elf64",   "64", source, sizeof source - 1 },
+    { "elfx32",  "32", source, sizeof source - 1 },
+    { "win32",   "32", source, sizeof source - 1 },
+    { "win64",   "64", source, sizeof source - 1 },
+    { "coff",    "32", source, sizeof source - 1 },
+    { "macho32", "32", source, sizeof source - 1 },
+    { "macho64", "64", source, sizeof source - 1 },
+    { "obj",     "32", source, sizeof source - 1 },
+    { "ieee",    "32", ieee_source, sizeof ieee_source - 1 },
+    { "as86",    "32", source, sizeof source - 1 },
+    { "aout",    "32", source, sizeof source - 1 },
+    { "aoutb",   "32", source, sizeof source - 1 },
+    { "bin",     "32", source, sizeof source - 1 },
+    { "dbg",     "32", source, sizeof source - 1 }
+};
+
+static bool same_result(const struct nasm_result *a,
+                        const struct nasm_result *b)
+{
+    return a->status == b->status &&
+        a->output_len == b->output_len &&
+        (!a->output_len || !memcmp(a->output, b->output, a->output_len)) &&
+        a->diagnostics_len == b->diagnostics_len &&
+        !memcmp(a->diagnostics, b->diagnostics, a->diagnostics_len) &&
+        a->nsymbols == b->nsymbols;
+}
+
+static bool test_format(const struct test_format *fmt, unsigned long count)
+{
+    const char *options[] = {
+        "-f", fmt->name, "-Ox", "--reproducible", "--before", NULL, NULL
+    };
+    char bits[32];
+    struct nasm_result first, res;
+    unsigned long i;
+    bool ok = true;
+
+    snprintf(bits, sizeof bits, "bits %s", fmt->bits);
+    options[5] = bits;
+
+    nasm_assemble_buffer(fmt->source, fmt->len, options, &first);
+    if (first.status) {
+        printf("%s: assembly failed:\n%s", fmt->name,
+               first.diagnostics ? first.diagnostics : "");
+        nasm_free_result(&first);
+        return false;
+    }
+
+    for (i = 1; i < count && ok; i++) {
+        nasm_assemble_buffer(fmt->source, fmt->len, options, &res);
+        if (!same_result(&first, &res)) {
+            printf("%s: call %lu returned a different result\n",
+                   fmt->name, i + 1);
+            ok = false;
+        }
+        nasm_free_result(&res);
+    }
+    nasm_free_result(&first);
+
+    if (ok && leak_check()) {
+        printf("%s: memory leaked\n", fmt->name);
+        ok = false;
+    }
+
+    printf("%s: %s\n", fmt->name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+/*
+ * Options which print something and exit on the command line
+ */
+static const char * const exit_options[][3] = {
+    { "-v", NULL, NULL },
+    { "--version", NULL, NULL },
+    { "-h", NULL, NULL },
+    { "--help", NULL, NULL },
+    { "-y", NULL, NULL },
+    { "@libtest-no-such-file", NULL, NULL },
+    { "-@", "libtest-no-such-file", NULL }
+};
+
+static bool test_exit_options(void)
+{
+    const char *options[5];
+    struct nasm_result res;
+    size_t i;
+    bool ok = true;
+
+    for (i = 0; i < ARRAY_SIZE(exit_options); i++) {
+        options[0] = "-f";
+        options[1] = "bin";
+        options[2] = exit_options[i][0];
+        options[3] = exit_options[i][1];
+        options[4] = NULL;
+
+        nasm_assemble_buffer(source, sizeof source - 1, options, &res);
+        if (!res.status || res.output) {
+            printf("%s: did not fail\n", exit_options[i][0]);
+            ok = false;
+        }
+        nasm_free_result(&res);
+    }
+
+    if (ok && leak_check()) {
+        printf("exit options: memory leaked\n");
+        ok = false;
+    }
+
+    printf("exit options: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long count = 20;
+    size_t i;
+    int opt, j;
+    bool ok = true;
+
+    for (opt = 1; opt < argc && argv[opt][0] == '-'; opt++) {
+        if (!strcmp(argv[opt], "-n") && opt+1 < argc) {
+            count = strtoul(argv[++opt], NULL, 10);
+            if (!count)
+                count = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [-n count] [format...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /* Run these first, so the formats also check what they leave behind */
+    if (opt >= argc)
+        ok &= test_exit_options();
+
+    for (i = 0; i < ARRAY_SIZE(formats); i++) {
+        if (opt < argc) {
+            for (j = opt; j < argc; j++) {
+                if (!strcmp(argv[j], formats[i].name))
+                    break;
+            }
+            if (j >= argc)
+                continue;
+        }
+        ok &= test_format(&formats[i], count);
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+;; EQU chains whose inputs change while jumps are being optimized,
+;; mixed with constant chains, $-relative and local-label operands.
+
+	bits 32
+start:
+	jmp near_end
+	jmp mid3
+
+a	equ far_end - start
+b	equ a + 1
+c	equ b * 2 + a
+s	equ 'ab'
+c0	equ 1234
+c1	equ c0 * 3
+c2	equ c1 - c0 + c
+.loc:
+l1	equ .loc - start
+
+%assign n 0
+%rep 3
+ %assign n n+1
+	jmp far_end
+	times 20 nop
+mid %+ n:
+%endrep
+
+here	equ $ - start
+near_end:
+	times 100 nop
+far_end:
+	dd a, b, c, s, l1, here
+	dd c0, c1, c2
+	dd fwd
+fwd	equ c - b
+d2	equ a
+d3	equ d2
+	dd d3
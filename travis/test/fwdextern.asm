@@ -0,0 +1,10 @@
+;
+; Symbols declared extern and then defined later in the file are
+; forward references in pass 1, so the optimizer has to run.
+;
+	extern V1, V2
+a:	push V1
+b:	push V2
+c:	dd c
+V1	equ 3
+V2	equ 600 - (b-a)*120
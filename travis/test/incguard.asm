@@ -0,0 +1,24 @@
+;
+; Multiple inclusion of files with and without include guards
+;
+	%include "incguard_a.asm"
+	%include "incguard_a.asm"
+	%include "incguard_b.asm"
+	%include "incguard_b.asm"
+	%include "incguard_c.asm"
+	%include "incguard_c.asm"
+	%include "incguard_a.asm"
+
+	; Including again after the guard is gone
+	%undef GUARD_A
+	%include "incguard_a.asm"
+	%include "incguard_a.asm"
+
+	; A guard defined case-insensitively also counts
+	%idefine guard_d 1
+	%include "incguard_d.asm"
+	%undef guard_d
+	%include "incguard_d.asm"
+	%include "incguard_d.asm"
+
+	db 'end'
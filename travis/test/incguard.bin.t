@@ -0,0 +1 @@
+abBcCCadend
\ No newline at end of file
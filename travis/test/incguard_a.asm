@@ -0,0 +1,9 @@
+; This file is part of the include guard test.
+; See incguard.asm.
+
+%ifndef GUARD_A
+  %define GUARD_A
+	db 'a'
+%endif
+
+; Comments after the guard are still fine
@@ -0,0 +1,7 @@
+; This file is part of the include guard test: %else means no guard
+%ifndef GUARD_B
+  %define GUARD_B
+	db 'b'
+%else
+	db 'B'
+%endif
@@ -0,0 +1,6 @@
+; This file is part of the include guard test: code after the %endif
+%ifndef GUARD_C
+  %define GUARD_C
+	db 'c'
+%endif
+	db 'C'
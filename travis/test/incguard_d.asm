@@ -0,0 +1,4 @@
+%ifndef GUARD_D
+  %define GUARD_D
+	db 'd'
+%endif
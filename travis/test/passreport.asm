@@ -0,0 +1,24 @@
+;
+; Each jump only needs the long form once the jump after it
+; has grown, so this takes one optimization pass per jump.
+;
+	bits 32
+
+j0:	jmp t0
+	times 123 nop
+j1:	jmp t1
+t0:
+	times 123 nop
+j2:	jmp t2
+t1:
+	times 123 nop
+j3:	jmp t3
+t2:
+	times 123 nop
+j4:	jmp t4
+t3:
+	times 130 nop
+t4:	ret
+
+len	equ t3 - j0
+	dd len
@@ -0,0 +1,19 @@
+	bits 32
+
+%macro emit 2
+  %if %2 == 3
+	%warning preprocessor warning for %1
+  %endif
+	mov eax, %1
+	db %2 * 100
+%endmacro
+
+%assign n 0
+%rep 5
+	emit n, n
+  %assign n n+1
+%endrep
+	jmp short done
+	times 8 nop
+done:
+	ret
@@ -0,0 +1,42 @@
+;
+; Integer arithmetic in preprocessor expressions
+;
+%assign i 0
+%rep 4
+%assign i i+1
+%assign sq i*i
+	dd i, sq, -i, ~i, !i, +i
+%endrep
+
+%assign a 7
+%assign b -3
+	dq %eval(a+b), %eval(a-b), %eval(a*b)
+	dq %eval(a/b), %eval(a % b), %eval(a//b), %eval(a %% b)
+	dq %eval(a<<3), %eval(b>>1), %eval(b>>>1), %eval(a<<<2)
+	dq %eval(a&b), %eval(a|b), %eval(a^b)
+	dq %eval(a&&b), %eval(a||0), %eval(a^^b), %eval(0^^0)
+	dq %eval(a==b), %eval(a!=b), %eval(a<>b), %eval(a=7)
+	dq %eval(a<b), %eval(a>b), %eval(a<=7), %eval(a>=8)
+	dq %eval(a<=>b), %eval(a<=>a)
+	dq %eval((a+b)*2), %eval(a+b*2), %eval(-(a)), %eval(!!a)
+	dq %eval(a>b ? a : b), %eval(a<b ? a : b ? 1 : 2)
+	dq %eval(0x7fffffffffffffff+1), %eval(0ffffffffffffffffh), %eval(18446744073709551615)
+	dq %eval('a'), %eval('ab'+1), %eval('abcdefgh')
+	dq %eval(1 << 63), %eval(5 / 0ffffffffffffffffh)
+
+%if a > 5 && b < 0
+	db 'yes'
+%else
+	db 'no'
+%endif
+
+%substr s 'hello, world' a-5, i-1
+%strlen n s
+	db s, n
+	db %eval(a*100+b)
+%rotate 1
+
+%assign c 1/0
+%assign d 1 <=> 2
+%assign e 1.5
+%assign f $ + 1
@@ -0,0 +1,69 @@
+;
+; Lines in false conditional branches are dropped without being
+; tokenized, unless they might be condition or line directives.
+;
+%define YES
+
+%ifdef NO
+	db 'unterminated
+%error never
+	%if 1
+		db 1
+	%else
+		db 2
+	%endif
+  %IFDEF YES
+	db 3
+  %ELSE
+	db 4
+  %ENDIF
+%{ifdef} YES
+	db 5
+%endif
+%macro m 0
+	%if 1
+	%endif
+%endmacro
+%rep 3
+%endrep
+%%local:
+%$ctx:
+%[YES]
+%+
+%iffy
+%elifdef YES
+	db 'elif taken'
+%else
+	db 'else'
+%endif
+
+%if 0
+# 100 "other.c"
+	db __?LINE?__
+%line 200+1 line.asm
+	db __?LINE?__
+%endif
+	db __?LINE?__
+
+%ifidni a, A
+	db 'true'
+%elif 1
+	%ifdef NO
+	%elif 1
+	%endif
+	db 'false'
+%else
+	%if 1
+	%endif
+%endif
+
+%if 1
+	db 'true'
+%elifdef YES
+%if 1
+%else
+%endif
+	db 'not reached'
+%else
+	db 'not reached'
+%endif
@@ -0,0 +1,31 @@
+;; Repeated section specifiers interleaved with code, data and labels,
+;; as typically generated by compilers.
+
+%ifidn __?OUTPUT_FORMAT?__, macho64
+	subsections_via_symbols
+%endif
+
+	section .text
+	global f1, f2
+f1:
+	mov eax,[rel v1]
+	section .data
+v1:	dd 1
+	section .text
+	add eax,[rel v2]
+	section .data
+v2:	dd 2
+	dq f1
+	section .text
+f2:
+	ret
+	section .data align=16
+v3:	dq f2
+	section .text
+	call f1
+	section .bss
+b1:	resd 4
+	section .data
+	dq b1
+	section .text
+	jmp f2
@@ -0,0 +1,13 @@
+;; A repeated section specifier must warn every time it is used,
+;; not only the first time.
+
+	section .data foo
+	db 1
+	section .text
+	nop
+	section .data foo
+	db 2
+	section .text
+	nop
+	section .data foo
+	db 3
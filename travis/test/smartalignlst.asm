@@ -0,0 +1,29 @@
+;; smartalign padding must be listed as a repeated sequence, the way
+;; the TIMES lines of the old macros were, and must warn once per byte
+;; in a BSS section as DB did.
+
+%use smartalign
+
+	bits 32
+	section .text
+
+	alignmode nop
+	nop
+	align 128
+	ret
+
+	alignmode k8
+	nop
+	nop
+	nop
+	align 16
+	ret
+
+	alignmode p6
+	nop
+	align 32
+	ret
+
+	section .bss
+	resb 3
+	align 8
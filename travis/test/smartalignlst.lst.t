@@ -0,0 +1,35 @@
+     1                                  ;; smartalign padding must be listed as a repeated sequence, the way
+     2                                  ;; the TIMES lines of the old macros were, and must warn once per byte
+     3                                  ;; in a BSS section as DB did.
+     4                                  
+     5                                  %use smartalign
+     6                                  
+     7                                  	bits 32
+     8                                  	section .text
+     9                                  
+    10                                  	alignmode nop
+    11 00000000 90                      	nop
+    12 00000001 EB7D90<rep 7Dh>         	align 128
+    13 00000080 C3                      	ret
+    14                                  
+    15                                  	alignmode k8
+    16 00000081 90                      	nop
+    17 00000082 90                      	nop
+    18 00000083 90                      	nop
+    19 00000084 66666690<rep 3h>        	align 16
+    20 00000090 C3                      	ret
+    21                                  
+    22                                  	alignmode p6
+    23 00000091 90                      	nop
+    24 00000092 0F1F84000000000066-     	align 32
+    24 0000009B 0F1F440000         
+    25 000000A0 C3                      	ret
+    26                                  
+    27                                  	section .bss
+    28 00000000 ??????                  	resb 3
+    29 00000003 0F1F440000              	align 8
+    29          ******************       warning: attempt to initialize memory in a nobits section: ignored [-w+other]
+    29          ******************       warning: attempt to initialize memory in a nobits section: ignored [-w+other]
+    29          ******************       warning: attempt to initialize memory in a nobits section: ignored [-w+other]
+    29          ******************       warning: attempt to initialize memory in a nobits section: ignored [-w+other]
+    29          ******************       warning: attempt to initialize memory in a nobits section: ignored [-w+other]